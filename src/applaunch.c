@@ -0,0 +1,308 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <string.h>
+#include <glib/gi18n.h>
+#include <gio/gio.h>
+#include <gio/gdesktopappinfo.h>
+#include <gtk/gtk.h>
+#include <libfm/fm-gtk.h>
+
+#include "applaunch.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+/* A launch context with values taken from GDK's on the main thread, so that it can be used in a worker thread */
+typedef struct
+{
+    GAppLaunchContext parent;
+    char *display;
+    char *startup_id;
+} PreparedContext;
+
+typedef struct
+{
+    GAppLaunchContextClass parent_class;
+} PreparedContextClass;
+
+typedef struct
+{
+    char *file;                     /* Desktop file to launch, or NULL to look up the id or for a command line */
+    char *command;                  /* Command line to launch */
+    char *id;                       /* Desktop id to look up if the desktop file cannot be loaded */
+    char *uri;                      /* Folder to open in the file manager */
+    GtkWindow *parent;              /* Window for error messages, may be NULL */
+    guint32 time;                   /* Time of the event which started the launch */
+    GAppInfo *info;                 /* App, once loaded */
+    GAppLaunchContext *gdk_ctx;     /* GDK's context, only used on the main thread */
+    GAppLaunchContext *ctx;         /* Prepared copy of it for the worker */
+    AppLaunchCallback func;
+    gpointer data;
+} LaunchJob;
+
+G_DEFINE_TYPE (PreparedContext, prepared_context, G_TYPE_APP_LAUNCH_CONTEXT)
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+/* Prepared launch context */
+
+static char *prepared_context_get_display (GAppLaunchContext *ctx, G_GNUC_UNUSED GAppInfo *info,
+    G_GNUC_UNUSED GList *files)
+{
+    return g_strdup (((PreparedContext *) ctx)->display);
+}
+
+static char *prepared_context_get_startup_notify_id (GAppLaunchContext *ctx, G_GNUC_UNUSED GAppInfo *info,
+    G_GNUC_UNUSED GList *files)
+{
+    return g_strdup (((PreparedContext *) ctx)->startup_id);
+}
+
+static void prepared_context_finalize (GObject *obj)
+{
+    PreparedContext *ctx = (PreparedContext *) obj;
+
+    g_free (ctx->display);
+    g_free (ctx->startup_id);
+    G_OBJECT_CLASS (prepared_context_parent_class)->finalize (obj);
+}
+
+static void prepared_context_class_init (PreparedContextClass *klass)
+{
+    GAppLaunchContextClass *ctx_class = G_APP_LAUNCH_CONTEXT_CLASS (klass);
+
+    G_OBJECT_CLASS (klass)->finalize = prepared_context_finalize;
+    ctx_class->get_display = prepared_context_get_display;
+    ctx_class->get_startup_notify_id = prepared_context_get_startup_notify_id;
+}
+
+static void prepared_context_init (G_GNUC_UNUSED PreparedContext *ctx)
+{
+}
+
+/* Runs on the main thread - asks GDK for everything it would give the child, so that it gets the startup
+ * notification id (or Wayland activation token) and display it would have had if launched from here */
+
+static void prepare_context (LaunchJob *job)
+{
+    GdkAppLaunchContext *gdk_ctx = gdk_display_get_app_launch_context (gdk_display_get_default ());
+    PreparedContext *ctx = g_object_new (prepared_context_get_type (), NULL);
+    char **env, **var, *eq;
+
+    gdk_app_launch_context_set_timestamp (gdk_ctx, job->time);
+    job->gdk_ctx = G_APP_LAUNCH_CONTEXT (gdk_ctx);
+    job->ctx = G_APP_LAUNCH_CONTEXT (ctx);
+
+    ctx->display = g_app_launch_context_get_display (job->gdk_ctx, job->info, NULL);
+
+    /* GIO only asks for an id for apps which say they support startup notification, so do the same */
+    if (G_IS_DESKTOP_APP_INFO (job->info) && g_desktop_app_info_get_boolean (G_DESKTOP_APP_INFO (job->info), "StartupNotify"))
+        ctx->startup_id = g_app_launch_context_get_startup_notify_id (job->gdk_ctx, job->info, NULL);
+
+    env = g_app_launch_context_get_environment (job->gdk_ctx);
+    for (var = env; var && *var; var++)
+    {
+        eq = strchr (*var, '=');
+        if (!eq) continue;
+        *eq = 0;
+        g_app_launch_context_setenv (job->ctx, *var, eq + 1);
+    }
+    g_strfreev (env);
+}
+
+static void launch_job_free (LaunchJob *job)
+{
+    g_free (job->file);
+    g_free (job->command);
+    g_free (job->id);
+    g_free (job->uri);
+    if (job->info) g_object_unref (job->info);
+    if (job->ctx) g_object_unref (job->ctx);
+    if (job->gdk_ctx) g_object_unref (job->gdk_ctx);
+    if (job->parent) g_object_unref (job->parent);
+    g_free (job);
+}
+
+/* Runs on the main thread once the launch has succeeded or failed */
+
+static void launch_finish (LaunchJob *job, gboolean ok, GError *err)
+{
+    if (!ok)
+    {
+        app_launch_fm_init ();
+        fm_show_error (job->parent, NULL, err->message);
+    }
+    if (err) g_error_free (err);
+
+    if (job->func) job->func (ok, job->data);
+    launch_job_free (job);
+}
+
+/* The job is freed in launch_finish rather than with either task, which may be finalised in the worker - the parent
+ * window and GDK's context must only be released on the main thread */
+
+static void launch_in_thread (LaunchJob *job, GTaskThreadFunc func, GAsyncReadyCallback done)
+{
+    GTask *task = g_task_new (NULL, NULL, done, NULL);
+
+    g_task_set_task_data (task, job, NULL);
+    g_task_run_in_thread (task, func);
+    g_object_unref (task);
+}
+
+/* Runs in a GIO worker thread - spawning the child can block */
+
+static void spawn_thread (GTask *task, G_GNUC_UNUSED gpointer source, gpointer task_data, G_GNUC_UNUSED GCancellable *cancel)
+{
+    LaunchJob *job = (LaunchJob *) task_data;
+    GList *uris = job->uri ? g_list_prepend (NULL, job->uri) : NULL;
+    GError *err = NULL;
+
+    if (g_app_info_launch_uris (job->info, uris, job->ctx, &err)) g_task_return_boolean (task, TRUE);
+    else g_task_return_error (task, err);
+    g_list_free (uris);
+}
+
+static void spawn_done (G_GNUC_UNUSED GObject *source, GAsyncResult *res, G_GNUC_UNUSED gpointer data)
+{
+    LaunchJob *job = (LaunchJob *) g_task_get_task_data (G_TASK (res));
+    PreparedContext *ctx = (PreparedContext *) job->ctx;
+    GError *err = NULL;
+    gboolean ok;
+
+    /* clears the busy cursor which the startup notification started */
+    ok = g_task_propagate_boolean (G_TASK (res), &err);
+    if (!ok && ctx->startup_id) g_app_launch_context_launch_failed (job->gdk_ctx, ctx->startup_id);
+    launch_finish (job, ok, err);
+}
+
+/* Runs in a GIO worker thread - loading a desktop file from a slow home directory can block, as can looking for
+ * it by id in the data directories, which is how the menu found the app if the file it named has gone, or looking
+ * up the file manager */
+
+static void load_thread (GTask *task, G_GNUC_UNUSED gpointer source, gpointer task_data, G_GNUC_UNUSED GCancellable *cancel)
+{
+    LaunchJob *job = (LaunchJob *) task_data;
+    GAppInfo *info = NULL;
+    GError *err = NULL;
+
+    if (job->uri)
+    {
+        info = g_app_info_get_default_for_type ("inode/directory", TRUE);
+        if (!info) g_set_error_literal (&err, G_SHELL_ERROR, G_SHELL_ERROR_EMPTY_STRING, _("No file manager is configured."));
+    }
+    else if (job->file || job->id)
+    {
+        if (job->file) info = (GAppInfo *) g_desktop_app_info_new_from_filename (job->file);
+        if (!info && job->id) info = (GAppInfo *) g_desktop_app_info_new (job->id);
+        if (!info) g_set_error (&err, G_IO_ERROR, G_IO_ERROR_INVALID_DATA, _("Could not load %s"), job->file ? job->file : job->id);
+    }
+    else info = g_app_info_create_from_commandline (job->command, NULL, G_APP_INFO_CREATE_NONE, &err);
+
+    if (info) g_task_return_pointer (task, info, g_object_unref);
+    else g_task_return_error (task, err);
+}
+
+static void load_done (G_GNUC_UNUSED GObject *source, GAsyncResult *res, G_GNUC_UNUSED gpointer data)
+{
+    LaunchJob *job = (LaunchJob *) g_task_get_task_data (G_TASK (res));
+    GError *err = NULL;
+
+    job->info = g_task_propagate_pointer (G_TASK (res), &err);
+    if (!job->info)
+    {
+        launch_finish (job, FALSE, err);
+        return;
+    }
+
+    prepare_context (job);
+    launch_in_thread (job, spawn_thread, spawn_done);
+}
+
+static void launch_start (LaunchJob *job)
+{
+    job->time = gtk_get_current_event_time ();
+    launch_in_thread (job, load_thread, load_done);
+}
+
+/* libfm is only needed to launch through the menu, for errors and for the context menu and drag and drop, so
+ * wf-panel initialises it on first use rather than at startup; lxpanel has always done so itself */
+
+void app_launch_fm_init (void)
+{
+#ifndef LXPLUG
+    static gboolean done = FALSE;
+
+    if (done) return;
+    fm_gtk_init (NULL);
+    fm_init (NULL);
+    done = TRUE;
+#endif
+}
+
+/* Launch an app from its desktop file without blocking; mpath, if given, is its menu path, the last part of which is
+ * the desktop id to look for if the file cannot be loaded or is NULL */
+
+void app_launch_file (const char *file, const char *mpath)
+{
+    LaunchJob *job = g_new0 (LaunchJob, 1);
+    const char *leaf = mpath ? strrchr (mpath, '/') : NULL;
+
+    job->file = g_strdup (file);
+    if (mpath) job->id = g_strdup (leaf ? leaf + 1 : mpath);
+    launch_start (job);
+}
+
+/* Open a folder in the default file manager without blocking */
+
+void app_launch_folder (const char *uri)
+{
+    LaunchJob *job = g_new0 (LaunchJob, 1);
+
+    job->uri = g_strdup (uri);
+    launch_start (job);
+}
+
+/* Launch a command line without blocking; func, if given, is told whether it started */
+
+void app_launch_command (GtkWindow *parent, const char *command, AppLaunchCallback func, gpointer data)
+{
+    LaunchJob *job = g_new0 (LaunchJob, 1);
+
+    job->command = g_strdup (command);
+    job->parent = parent ? g_object_ref (parent) : NULL;
+    job->func = func;
+    job->data = data;
+    launch_start (job);
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,859 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <locale.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <gtk/gtk.h>
+#include <menu-cache.h>
+
+#ifdef LXPLUG
+#include <libfm/fm-gtk.h>
+#endif
+
+#include "smatch.h"
+#include "strpool.h"
+#include "catalog.h"
+#include "trace.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+#define FALLBACK_ICON "application-x-executable"
+
+#define SNAPSHOT_MAGIC      0x534d4e53
+#define SNAPSHOT_VERSION    1
+
+/* The snapshot file is a header, the node and app tables, the folded name offsets, then NUL-terminated strings and
+ * the folded names with their padding. Offsets are from the start of the file, with 0 meaning NULL. */
+typedef struct
+{
+    guint32 magic;
+    guint32 version;
+    gint64 stamp;                   /* Stamp of the menu cache files it was made from */
+    guint32 key;                    /* Offset of the locale and menu name */
+    guint32 nnodes;
+    guint32 napps;
+    guint32 folded;                 /* Offset of the folded names, which are followed by SMATCH_PAD zeroed bytes */
+    guint32 folded_len;
+    guint32 reserved;
+} SnapshotHeader;
+
+typedef struct
+{
+    guint32 name;
+    guint32 icon;
+    guint32 path;
+    guint32 entry;                  /* Index of the app plus one, or 0 */
+    guint32 type;
+    guint32 size;
+} SnapshotNode;
+
+typedef struct
+{
+    guint32 name;
+    guint32 dir;
+    guint32 id;
+    guint32 file;
+    guint32 icon;
+} SnapshotApp;
+
+typedef struct
+{
+    CatalogNotify func;
+    gpointer data;
+} CatalogListener;
+
+/* An entry in the icon store; one which was evicted stays as a stub, so that decoding it again can be counted */
+typedef struct
+{
+    GdkPixbuf *pixbuf;              /* NULL if the icon was not found or has been evicted */
+    gsize bytes;                    /* Size of the pixel data */
+    gboolean evicted;
+    gboolean fallback;              /* Set if the icon was not found, so the fallback icon is used in its place */
+    guint mapped;                   /* Number of menu images showing it, which keep it from being evicted */
+    GList link;                     /* Place in the store's LRU list while it holds a pixbuf */
+} StoredIcon;
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+/* Shared by every plugin instance in the process, so the menu is read and its icons decoded once however many panels there are */
+static Catalog *catalog;
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+#ifndef DISABLE_MENU
+extern void gtk_run_set_menu_cache (MenuCache *cache);
+extern void gtk_run_unset_menu_cache (MenuCache *cache);
+#endif
+extern void gtk_run_cleanup (void);
+
+static AppIndex *app_index_new (void);
+static AppEntry *app_index_add (AppIndex *index, const char *name, const char *mpath, const char *file, const char *icon);
+static void notify_listeners (Catalog *cat);
+static void free_nodes (Catalog *cat);
+static guint add_dir_nodes (Catalog *cat, MenuCacheDir *dir);
+static gboolean menu_cache_stamp (gint64 *stamp);
+static char *snapshot_path (void);
+static guint32 put_string (GString *out, GHashTable *strings, const char *str);
+static void snapshot_save (Catalog *cat);
+static const char *get_string (const char *data, gsize size, guint32 offset, gboolean *ok);
+static gboolean snapshot_load (Catalog *cat);
+static void handle_reload (MenuCache *cache, gpointer user_data);
+static void handle_icon_theme_changed (GtkIconTheme *theme, gpointer user_data);
+static void release_icon (gpointer data);
+static void clear_icons (Catalog *cat);
+static void evict_icons (Catalog *cat, gsize budget);
+static StoredIcon *find_icon (Catalog *cat, const char *name, int size);
+static GdkPixbuf *load_icon (const char *name, int size);
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+/* App index - every app in the menu, read-only once built so the search worker can scan it */
+
+static AppIndex *app_index_new (void)
+{
+    AppIndex *index = g_new0 (AppIndex, 1);
+    index->ref = 1;
+    index->pool = strpool_new ();
+    index->apps = g_ptr_array_new ();
+    smatch_init (&index->folded);
+    return index;
+}
+
+AppIndex *app_index_ref (AppIndex *index)
+{
+    g_atomic_int_inc (&index->ref);
+    return index;
+}
+
+void app_index_unref (AppIndex *index)
+{
+    if (!g_atomic_int_dec_and_test (&index->ref)) return;
+    g_ptr_array_unref (index->apps);
+    smatch_free (&index->folded);
+    strpool_free (index->pool);
+    if (index->snapshot) g_mapped_file_unref (index->snapshot);
+    g_free (index);
+}
+
+static AppEntry *app_index_add (AppIndex *index, const char *name, const char *mpath, const char *file, const char *icon)
+{
+    AppEntry *entry = strpool_alloc (index->pool, sizeof (AppEntry));
+    const char *leaf = strrchr (mpath, '/');
+
+    /* the category part of the path is the same for all apps in it, so only store it once */
+    leaf = leaf ? leaf + 1 : mpath;
+    entry->name = strpool_intern (index->pool, name);
+    entry->dir = strpool_intern_len (index->pool, mpath, leaf - mpath);
+    entry->id = strpool_intern (index->pool, leaf);
+    entry->file = file ? strpool_intern (index->pool, file) : NULL;
+    entry->icon = icon ? strpool_intern (index->pool, icon) : NULL;
+
+    g_ptr_array_add (index->apps, entry);
+    smatch_add (&index->folded, name);
+    return entry;
+}
+
+/* Listeners */
+
+gpointer catalog_add_notify (Catalog *cat, CatalogNotify func, gpointer data)
+{
+    CatalogListener *l = g_new (CatalogListener, 1);
+
+    l->func = func;
+    l->data = data;
+    cat->listeners = g_slist_append (cat->listeners, l);
+    return l;
+}
+
+void catalog_remove_notify (Catalog *cat, gpointer notify_id)
+{
+    cat->listeners = g_slist_remove (cat->listeners, notify_id);
+    g_free (notify_id);
+}
+
+static void notify_listeners (Catalog *cat)
+{
+    GSList *l;
+
+    for (l = cat->listeners; l; l = l->next)
+    {
+        CatalogListener *listener = (CatalogListener *) l->data;
+        listener->func (listener->data);
+    }
+}
+
+/* Nodes - the visible part of the menu, flattened once for every instance to build its widgets from */
+
+static void free_nodes (Catalog *cat)
+{
+    if (!cat->nodes) return;
+    g_array_free (cat->nodes, TRUE);
+    cat->nodes = NULL;
+}
+
+/* Appends the visible items in a directory, depth first, leaving out empty directories; returns the number of nodes added */
+static guint add_dir_nodes (Catalog *cat, MenuCacheDir *dir)
+{
+    GSList *l, *children;
+    MenuCacheItem *item;
+    CatalogNode *node;
+    StrPool *pool = cat->index->pool;
+    char *path, *mpath, *file;
+    guint count = 0, pos, size;
+    MenuCacheType type;
+
+    children = menu_cache_dir_list_children (dir);
+    for (l = children; l; l = l->next)
+    {
+        item = MENU_CACHE_ITEM (l->data);
+        switch (menu_cache_item_get_type (item))
+        {
+            case MENU_CACHE_TYPE_APP :  if (!menu_cache_app_get_is_visible (MENU_CACHE_APP (item), SHOW_IN_LXDE)) continue;
+                                        break;
+            case MENU_CACHE_TYPE_DIR :  if (!menu_cache_dir_is_visible (MENU_CACHE_DIR (item))) continue;
+                                        break;
+            default :                   break;
+        }
+
+        /* only apps and directories have a path worth keeping - a separator has no id to make one from */
+        type = menu_cache_item_get_type (item);
+        if (type == MENU_CACHE_TYPE_APP || type == MENU_CACHE_TYPE_DIR) path = menu_cache_dir_make_path (MENU_CACHE_DIR (item));
+        else path = NULL;
+        pos = cat->nodes->len;
+        g_array_set_size (cat->nodes, pos + 1);
+        node = &g_array_index (cat->nodes, CatalogNode, pos);
+        node->name = menu_cache_item_get_name (item) ? strpool_intern (pool, menu_cache_item_get_name (item)) : "";
+        node->icon = menu_cache_item_get_icon (item) ? strpool_intern (pool, menu_cache_item_get_icon (item)) : NULL;
+        node->path = path ? strpool_intern (pool, path) : NULL;
+        node->entry = NULL;
+        node->type = type;
+        node->size = 0;
+
+        if (node->type == MENU_CACHE_TYPE_DIR)
+        {
+            /* the array may move as the directory is added */
+            size = add_dir_nodes (cat, MENU_CACHE_DIR (item));
+            if (!size)
+            {
+                g_array_set_size (cat->nodes, pos);
+                g_free (path);
+                continue;
+            }
+            g_array_index (cat->nodes, CatalogNode, pos).size = size;
+            count += size;
+        }
+        else if (node->type == MENU_CACHE_TYPE_APP)
+        {
+            /* the same menu:// path libfm would make, without needing libfm */
+            mpath = g_strconcat ("menu://applications/", path + 14, NULL);
+            file = menu_cache_item_get_file_path (item);
+            node->entry = app_index_add (cat->index, node->name, mpath, file, node->icon);
+            g_free (file);
+            g_free (mpath);
+        }
+        g_free (path);
+        count++;
+    }
+    g_slist_free_full (children, (GDestroyNotify) menu_cache_item_unref);
+    return count;
+}
+
+/* Snapshot - the nodes and index as they were last made, which can be used in place while the menu cache loads */
+
+/* menu-cached rewrites its cache files whenever the menus change, so the newest of them dates the menus */
+static gboolean menu_cache_stamp (gint64 *stamp)
+{
+    char *path = g_build_filename (g_get_user_cache_dir (), "menus", NULL);
+    GDir *dir = g_dir_open (path, 0, NULL);
+    gboolean found = FALSE;
+    const char *name;
+    struct stat st;
+    char *file;
+
+    *stamp = 0;
+    if (dir)
+    {
+        while ((name = g_dir_read_name (dir)))
+        {
+            file = g_build_filename (path, name, NULL);
+            if (stat (file, &st) == 0 && S_ISREG (st.st_mode))
+            {
+                *stamp = MAX (*stamp, st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec);
+                found = TRUE;
+            }
+            g_free (file);
+        }
+        g_dir_close (dir);
+    }
+    g_free (path);
+    return found;
+}
+
+static char *snapshot_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "smenu", "catalog", NULL);
+}
+
+/* Strings from the index are interned, so each is only written once */
+static guint32 put_string (GString *out, GHashTable *strings, const char *str)
+{
+    gpointer offset;
+
+    if (!str) return 0;
+    if (g_hash_table_lookup_extended (strings, str, NULL, &offset)) return GPOINTER_TO_UINT (offset);
+
+    offset = GUINT_TO_POINTER (out->len);
+    g_string_append_len (out, str, strlen (str) + 1);
+    g_hash_table_insert (strings, (gpointer) str, offset);
+    return GPOINTER_TO_UINT (offset);
+}
+
+static void snapshot_save (Catalog *cat)
+{
+    AppIndex *index = cat->index;
+    SnapshotHeader header;
+    SnapshotNode snode;
+    SnapshotApp sapp;
+    CatalogNode *node;
+    AppEntry *entry;
+    GHashTable *strings, *apps;
+    GString *out;
+    gsize nodes_off, apps_off, offsets_off;
+    char *path, *dirpath;
+    guint i;
+
+    /* reserve the tables, then fill them in once the string offsets are known */
+    nodes_off = sizeof (SnapshotHeader);
+    apps_off = nodes_off + cat->nodes->len * sizeof (SnapshotNode);
+    offsets_off = apps_off + index->apps->len * sizeof (SnapshotApp);
+    out = g_string_sized_new (offsets_off + index->apps->len * sizeof (guint32) + 65536);
+    g_string_set_size (out, offsets_off + index->apps->len * sizeof (guint32));
+    memset (out->str, 0, out->len);
+
+    strings = g_hash_table_new (g_str_hash, g_str_equal);
+    apps = g_hash_table_new (NULL, NULL);
+    for (i = 0; i < index->apps->len; i++)
+    {
+        entry = g_ptr_array_index (index->apps, i);
+        g_hash_table_insert (apps, entry, GUINT_TO_POINTER (i + 1));
+        memset (&sapp, 0, sizeof (SnapshotApp));
+        sapp.name = put_string (out, strings, entry->name);
+        sapp.dir = put_string (out, strings, entry->dir);
+        sapp.id = put_string (out, strings, entry->id);
+        sapp.file = put_string (out, strings, entry->file);
+        sapp.icon = put_string (out, strings, entry->icon);
+        memcpy (out->str + apps_off + i * sizeof (SnapshotApp), &sapp, sizeof (SnapshotApp));
+    }
+    memcpy (out->str + offsets_off, index->folded.offsets, index->apps->len * sizeof (guint32));
+
+    for (i = 0; i < cat->nodes->len; i++)
+    {
+        node = &g_array_index (cat->nodes, CatalogNode, i);
+        memset (&snode, 0, sizeof (SnapshotNode));
+        snode.name = put_string (out, strings, node->name);
+        snode.icon = put_string (out, strings, node->icon);
+        snode.path = put_string (out, strings, node->path);
+        snode.entry = node->entry ? GPOINTER_TO_UINT (g_hash_table_lookup (apps, node->entry)) : 0;
+        snode.type = node->type;
+        snode.size = node->size;
+        memcpy (out->str + nodes_off + i * sizeof (SnapshotNode), &snode, sizeof (SnapshotNode));
+    }
+
+    memset (&header, 0, sizeof (SnapshotHeader));
+    header.magic = SNAPSHOT_MAGIC;
+    header.version = SNAPSHOT_VERSION;
+    header.stamp = cat->stamp;
+    header.key = put_string (out, strings, cat->key);
+    header.nnodes = cat->nodes->len;
+    header.napps = index->apps->len;
+    header.folded = out->len;
+    header.folded_len = index->folded.len;
+    g_string_append_len (out, index->folded.buf, index->folded.len);
+    g_string_set_size (out, out->len + SMATCH_PAD);
+    memset (out->str + out->len - SMATCH_PAD, 0, SMATCH_PAD);
+    memcpy (out->str, &header, sizeof (SnapshotHeader));
+    g_hash_table_destroy (strings);
+    g_hash_table_destroy (apps);
+
+    /* written to a new file and renamed, so a snapshot already mapped by another process is left alone */
+    path = snapshot_path ();
+    dirpath = g_path_get_dirname (path);
+    g_mkdir_with_parents (dirpath, 0700);
+    g_file_set_contents (path, out->str, out->len, NULL);
+    g_free (dirpath);
+    g_free (path);
+    g_string_free (out, TRUE);
+}
+
+static const char *get_string (const char *data, gsize size, guint32 offset, gboolean *ok)
+{
+    if (!offset) return NULL;
+    if (offset < sizeof (SnapshotHeader) || offset >= size) *ok = FALSE;
+    return *ok ? data + offset : NULL;
+}
+
+/* Makes the nodes and index from the snapshot, if it was made for the current locale, menu and menu cache files. Only
+ * the tables are read; the strings and folded names are used where they are mapped. */
+static gboolean snapshot_load (Catalog *cat)
+{
+    const SnapshotHeader *header;
+    const SnapshotNode *snodes;
+    const SnapshotApp *sapps;
+    const guint32 *offsets;
+    const char *data, *key, *folded;
+    GMappedFile *map;
+    AppIndex *index;
+    AppEntry *entry;
+    CatalogNode *node;
+    gboolean ok = TRUE;
+    gint64 stamp;
+    gsize size;
+    guint i;
+    char *path;
+
+    path = snapshot_path ();
+    map = g_mapped_file_new (path, FALSE, NULL);
+    g_free (path);
+    if (!map) return FALSE;
+
+    /* the last byte must be a terminator, so that no string can run off the end */
+    data = g_mapped_file_get_contents (map);
+    size = g_mapped_file_get_length (map);
+    header = (const SnapshotHeader *) data;
+    if (size < sizeof (SnapshotHeader) || header->magic != SNAPSHOT_MAGIC || header->version != SNAPSHOT_VERSION
+        || data[size - 1] || (size - sizeof (SnapshotHeader)) / (sizeof (SnapshotNode) + sizeof (SnapshotApp)) < MAX (header->nnodes, header->napps)
+        || header->folded > size || size - header->folded < (gsize) header->folded_len + SMATCH_PAD)
+    {
+        g_mapped_file_unref (map);
+        return FALSE;
+    }
+
+    key = get_string (data, size, header->key, &ok);
+    if (!ok || !key || strcmp (key, cat->key) || !menu_cache_stamp (&stamp) || stamp != header->stamp)
+    {
+        g_mapped_file_unref (map);
+        return FALSE;
+    }
+
+    snodes = (const SnapshotNode *) (data + sizeof (SnapshotHeader));
+    sapps = (const SnapshotApp *) (snodes + header->nnodes);
+    offsets = (const guint32 *) (sapps + header->napps);
+    folded = data + header->folded;
+    if ((const char *) (offsets + header->napps) > folded) ok = FALSE;
+
+    /* the match kernel walks each folded name to its terminator, so every row must start after the one before and
+     * end with a NUL inside the buffer */
+    if (header->napps && (!header->folded_len || folded[header->folded_len - 1])) ok = FALSE;
+
+    index = app_index_new ();
+    index->snapshot = map;
+    for (i = 0; ok && i < header->napps; i++)
+    {
+        entry = strpool_alloc (index->pool, sizeof (AppEntry));
+        entry->name = get_string (data, size, sapps[i].name, &ok);
+        entry->dir = get_string (data, size, sapps[i].dir, &ok);
+        entry->id = get_string (data, size, sapps[i].id, &ok);
+        entry->file = get_string (data, size, sapps[i].file, &ok);
+        entry->icon = get_string (data, size, sapps[i].icon, &ok);
+        if (!entry->name || !entry->dir || !entry->id || offsets[i] >= header->folded_len
+            || (i && (offsets[i] <= offsets[i - 1] || folded[offsets[i] - 1]))) ok = FALSE;
+        g_ptr_array_add (index->apps, entry);
+    }
+    if (ok) smatch_map (&index->folded, folded, header->folded_len, offsets, header->napps);
+
+    free_nodes (cat);
+    cat->nodes = g_array_sized_new (FALSE, FALSE, sizeof (CatalogNode), header->nnodes);
+    g_array_set_size (cat->nodes, ok ? header->nnodes : 0);
+    for (i = 0; ok && i < header->nnodes; i++)
+    {
+        node = &g_array_index (cat->nodes, CatalogNode, i);
+        node->name = get_string (data, size, snodes[i].name, &ok);
+        node->icon = get_string (data, size, snodes[i].icon, &ok);
+        node->path = get_string (data, size, snodes[i].path, &ok);
+        node->entry = snodes[i].entry && snodes[i].entry <= header->napps ? g_ptr_array_index (index->apps, snodes[i].entry - 1) : NULL;
+        node->type = snodes[i].type;
+        node->size = snodes[i].size;
+        if (!node->name || (!node->path && node->type != MENU_CACHE_TYPE_SEP) || snodes[i].entry > header->napps
+            || node->size >= header->nnodes - i || node->type > MENU_CACHE_TYPE_SEP) ok = FALSE;
+    }
+
+    if (!ok)
+    {
+        g_debug ("menu catalog snapshot is damaged");
+        free_nodes (cat);
+        app_index_unref (index);
+        return FALSE;
+    }
+
+    app_index_unref (cat->index);
+    cat->index = index;
+    cat->stamp = stamp;
+    return TRUE;
+}
+
+/* Called by the menu cache once it has loaded, and whenever it changes - the notify can also come for a root which
+ * has already been read, which is ignored */
+
+static void handle_reload (G_GNUC_UNUSED MenuCache *cache, gpointer user_data)
+{
+    Catalog *cat = (Catalog *) user_data;
+    MenuCacheDir *dir = menu_cache_dup_root_dir (cat->cache);
+    gint64 start, stamp;
+
+    if (dir == cat->root)
+    {
+        if (dir) menu_cache_item_unref (MENU_CACHE_ITEM (dir));
+        return;
+    }
+
+    if (cat->root) menu_cache_item_unref (MENU_CACHE_ITEM (cat->root));
+    cat->root = dir;
+    if (!dir) return;
+
+    /* the first root confirms the snapshot, unless menu-cached has rewritten its files since it was made */
+    if (cat->from_snapshot)
+    {
+        cat->from_snapshot = FALSE;
+        if (menu_cache_stamp (&stamp) && stamp == cat->stamp) return;
+    }
+
+    if (cat->ready_time < 0)
+    {
+        cat->ready_time = g_get_monotonic_time () - cat->load_start;
+        g_debug ("menu cache ready after %" G_GINT64_FORMAT " ms", cat->ready_time / 1000);
+    }
+
+    /* searches still running hold their own reference to the old index */
+    TRACE_BEGIN (reload);
+    start = g_get_monotonic_time ();
+    free_nodes (cat);
+    app_index_unref (cat->index);
+    cat->index = app_index_new ();
+    cat->nodes = g_array_new (FALSE, FALSE, sizeof (CatalogNode));
+    if (menu_cache_dir_is_visible (dir)) add_dir_nodes (cat, dir);
+    cat->build_time = g_get_monotonic_time () - start;
+    g_debug ("menu catalog read in %" G_GINT64_FORMAT " ms", cat->build_time / 1000);
+    TRACE_END (reload, "catalog_reload");
+
+    TRACE_BEGIN (notify);
+    notify_listeners (cat);
+    TRACE_END (notify, "catalog_notify");
+    if (menu_cache_stamp (&cat->stamp)) snapshot_save (cat);
+}
+
+/* Icon store - each icon is decoded once per size, whichever instance asks for it first. Decoded icons are limited to
+ * a budget in bytes; menu images acquire their icons while they are mapped and release them when unmapped, so once over
+ * budget, the least recently used icons which no image is showing are evicted. */
+
+static void release_icon (gpointer data)
+{
+    StoredIcon *stored = (StoredIcon *) data;
+
+    if (stored->pixbuf) g_object_unref (stored->pixbuf);
+    g_free (stored);
+}
+
+/* The list links are part of the entries, so the list is simply reset once they have all gone */
+static void clear_icons (Catalog *cat)
+{
+    g_hash_table_remove_all (cat->icons);
+    g_queue_init (&cat->lru);
+    cat->icon_bytes = 0;
+    cat->icon_gen++;
+}
+
+/* Evicts the least recently used icons which are not mapped until the store holds no more than the given bytes */
+static void evict_icons (Catalog *cat, gsize budget)
+{
+    StoredIcon *stored;
+    GList *l, *prev;
+    guint count = 0;
+
+    for (l = cat->lru.tail; l && cat->icon_bytes > budget; l = prev)
+    {
+        prev = l->prev;
+        stored = (StoredIcon *) l->data;
+        if (stored->mapped) continue;
+
+        g_queue_unlink (&cat->lru, l);
+        g_object_unref (stored->pixbuf);
+        stored->pixbuf = NULL;
+        stored->evicted = TRUE;
+        cat->icon_bytes -= stored->bytes;
+        stored->bytes = 0;
+        count++;
+    }
+
+    if (count)
+    {
+        cat->evictions += count;
+        g_debug ("icon store holds %" G_GSIZE_FORMAT " bytes after evicting %u icons (%u evictions, %u decoded again)",
+            cat->icon_bytes, count, cat->evictions, cat->redecodes);
+    }
+}
+
+static void handle_icon_theme_changed (G_GNUC_UNUSED GtkIconTheme *theme, gpointer user_data)
+{
+    Catalog *cat = (Catalog *) user_data;
+
+    clear_icons (cat);
+    notify_listeners (cat);
+}
+
+static GdkPixbuf *load_icon (const char *name, int size)
+{
+    GdkPixbuf *icon;
+
+#ifdef LXPLUG
+    FmIcon *fm_icon = fm_icon_from_name (name);
+    icon = fm_pixbuf_from_icon_with_fallback (fm_icon, size, FALLBACK_ICON);
+    g_object_unref (fm_icon);
+#else
+    char *fname;
+
+    if (strchr (name, '/')) return gdk_pixbuf_new_from_file_at_size (name, size, size, NULL);
+
+    icon = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (), name, size, GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
+
+    // fallback for packages using obsolete icon location
+    if (!icon)
+    {
+        fname = g_strdup_printf ("/usr/share/pixmaps/%s", name);
+        icon = gdk_pixbuf_new_from_file_at_size (fname, size, size, NULL);
+        g_free (fname);
+    }
+#endif
+    return icon;
+}
+
+/* Returns the icon with the given name at the given size, or the fallback icon if it cannot be found. The store keeps
+ * the reference, which is only good until the store is next used, so the caller must take its own straight away. */
+
+GdkPixbuf *catalog_icon (Catalog *cat, const char *name, int size)
+{
+    GHashTable *icons = g_hash_table_lookup (cat->icons, GINT_TO_POINTER (size));
+    StoredIcon *stored = NULL;
+
+    if (!name) name = FALLBACK_ICON;
+    if (!icons)
+    {
+        icons = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, release_icon);
+        g_hash_table_insert (cat->icons, GINT_TO_POINTER (size), icons);
+    }
+    else stored = g_hash_table_lookup (icons, name);
+
+    if (stored && stored->fallback) return catalog_icon (cat, FALLBACK_ICON, size);
+    if (stored && !stored->evicted)
+    {
+        if (stored->pixbuf)
+        {
+            g_queue_unlink (&cat->lru, &stored->link);
+            g_queue_push_head_link (&cat->lru, &stored->link);
+        }
+        return stored->pixbuf;
+    }
+
+    if (!stored)
+    {
+        stored = g_new0 (StoredIcon, 1);
+        stored->link.data = stored;
+        g_hash_table_insert (icons, g_strdup (name), stored);
+    }
+    else
+    {
+        stored->evicted = FALSE;
+        cat->redecodes++;
+    }
+
+    TRACE_BEGIN (start);
+    stored->pixbuf = load_icon (name, size);
+    TRACE_END (start, "icon_decode");
+    if (!stored->pixbuf)
+    {
+        if (!strcmp (name, FALLBACK_ICON)) return NULL;
+        stored->fallback = TRUE;
+        return catalog_icon (cat, FALLBACK_ICON, size);
+    }
+
+    /* the new icon is about to be returned, so it is only put in the LRU list once room has been made for it */
+    stored->bytes = gdk_pixbuf_get_byte_length (stored->pixbuf);
+    cat->icon_bytes += stored->bytes;
+    if (cat->icon_budget) evict_icons (cat, cat->icon_budget);
+    g_queue_push_head_link (&cat->lru, &stored->link);
+    return stored->pixbuf;
+}
+
+/* Finds the entry which holds the icon returned for the given name and size, if any */
+static StoredIcon *find_icon (Catalog *cat, const char *name, int size)
+{
+    GHashTable *icons = g_hash_table_lookup (cat->icons, GINT_TO_POINTER (size));
+    StoredIcon *stored = icons ? g_hash_table_lookup (icons, name ? name : FALLBACK_ICON) : NULL;
+
+    if (stored && stored->fallback) return find_icon (cat, FALLBACK_ICON, size);
+    return stored;
+}
+
+/* Returns the icon as catalog_icon does, and keeps it from being evicted until it is released. gen is set to the
+ * generation of the store, which must be passed back to release it. */
+
+GdkPixbuf *catalog_icon_acquire (Catalog *cat, const char *name, int size, guint *gen)
+{
+    GdkPixbuf *pixbuf = catalog_icon (cat, name, size);
+    StoredIcon *stored = find_icon (cat, name, size);
+
+    if (stored) stored->mapped++;
+    *gen = cat->icon_gen;
+    return pixbuf;
+}
+
+/* Releases an icon acquired with the same name and size. If the store has been cleared since, as for a new icon theme,
+ * the entry it was counted in has gone, and one made since with the same name must not lose a count it never had. */
+
+void catalog_icon_release (Catalog *cat, const char *name, int size, guint gen)
+{
+    StoredIcon *stored;
+
+    if (gen != cat->icon_gen) return;
+    stored = find_icon (cat, name, size);
+    if (stored && stored->mapped) stored->mapped--;
+}
+
+/* Sets the most bytes of decoded icons to keep, or 0 for no limit; the catalog is shared, so the last instance to set
+ * it wins */
+
+void catalog_set_icon_budget (Catalog *cat, gsize bytes)
+{
+    cat->icon_budget = bytes;
+    if (bytes) evict_icons (cat, bytes);
+}
+
+/* Returns a new reference to the loaded menu cache item with the given path, or NULL if the cache has not loaded yet */
+
+MenuCacheItem *catalog_find_item (const char *path)
+{
+    if (!catalog || !catalog->root) return NULL;
+    return menu_cache_item_from_path (catalog->cache, path);
+}
+
+/* Drops the decoded icons which are not mapped to save memory - they are decoded again when next asked for */
+
+void catalog_trim_icons (Catalog *cat)
+{
+    evict_icons (cat, 0);
+}
+
+/* The catalog is made by the first instance to need it and goes with the last */
+
+Catalog *catalog_ref (void)
+{
+    const char *name;
+    gint64 start;
+
+    if (catalog)
+    {
+        catalog->ref++;
+        return catalog;
+    }
+
+    catalog = g_new0 (Catalog, 1);
+    catalog->ref = 1;
+    catalog->index = app_index_new ();
+    catalog->icons = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify) g_hash_table_destroy);
+    g_queue_init (&catalog->lru);
+    catalog->ready_time = -1;
+    g_signal_connect (gtk_icon_theme_get_default (), "changed", G_CALLBACK (handle_icon_theme_changed), catalog);
+
+    name = g_getenv ("XDG_MENU_PREFIX") == NULL ? "lxde-applications.menu+hidden" : "applications.menu+hidden";
+    catalog->key = g_strdup_printf ("%s %s", setlocale (LC_MESSAGES, NULL), name);
+    catalog->load_start = g_get_monotonic_time ();
+
+    /* a snapshot gives the menu straight away, and is checked once the cache has loaded */
+    TRACE_BEGIN (snapshot);
+    start = g_get_monotonic_time ();
+    if (snapshot_load (catalog))
+    {
+        catalog->from_snapshot = TRUE;
+        catalog->build_time = g_get_monotonic_time () - start;
+        catalog->ready_time = g_get_monotonic_time () - catalog->load_start;
+        g_debug ("menu catalog read from snapshot in %" G_GINT64_FORMAT " ms", catalog->build_time / 1000);
+    }
+    TRACE_END (snapshot, "snapshot_load");
+
+    /* the lookup is asynchronous - otherwise the nodes are made once the reload notify says the cache is ready */
+    catalog->cache = menu_cache_lookup (name);
+    if (catalog->cache == NULL)
+    {
+        g_warning ("error loading applications menu");
+        return catalog;
+    }
+    catalog->reload_notify = menu_cache_add_reload_notify (catalog->cache, handle_reload, catalog);
+
+    /* the cache may already have been loaded */
+    handle_reload (catalog->cache, catalog);
+
+    /* the Run dialog matches commands against the same cache */
+#ifndef DISABLE_MENU
+    gtk_run_set_menu_cache (catalog->cache);
+#endif
+    return catalog;
+}
+
+void catalog_unref (Catalog *cat)
+{
+    if (--cat->ref) return;
+
+    g_signal_handlers_disconnect_by_func (gtk_icon_theme_get_default (), handle_icon_theme_changed, cat);
+    gtk_run_cleanup ();
+    if (cat->cache)
+    {
+#ifndef DISABLE_MENU
+        gtk_run_unset_menu_cache (cat->cache);
+#endif
+        menu_cache_remove_reload_notify (cat->cache, cat->reload_notify);
+        menu_cache_unref (cat->cache);
+    }
+    free_nodes (cat);
+    if (cat->root) menu_cache_item_unref (MENU_CACHE_ITEM (cat->root));
+    app_index_unref (cat->index);
+    g_hash_table_destroy (cat->icons);
+    g_slist_free_full (cat->listeners, g_free);
+    g_free (cat->key);
+    g_free (cat);
+    catalog = NULL;
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
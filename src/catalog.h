@@ -0,0 +1,111 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    const char *name;               /* Display name */
+    const char *dir;                /* Menu path of the containing category, shared between its apps; NULL for a command from PATH */
+    const char *id;                 /* Desktop id - last element of the menu path */
+    const char *file;               /* Desktop file, launched directly when known */
+    const char *icon;               /* Icon name or file, looked up in the catalog's icon store; NULL for the fallback */
+} AppEntry;
+
+typedef struct
+{
+    gint ref;
+    StrPool *pool;                  /* Arena holding the entries and all their strings */
+    GPtrArray *apps;                /* AppEntry for every app in the menu */
+    SMatchBuf folded;               /* Case-folded copy of names for the match kernel */
+    GMappedFile *snapshot;          /* Holds the names and other strings if read from a snapshot, otherwise NULL */
+} AppIndex;
+
+/* Strings are held by the catalog's index, so that a snapshot can be used in place */
+typedef struct
+{
+    const char *name;               /* Display name */
+    const char *icon;               /* Icon name or file, NULL for the fallback */
+    const char *path;               /* Path of the item in the menu cache; NULL for a separator */
+    AppEntry *entry;                /* Index entry for an app, NULL for a directory or separator */
+    guint type;                     /* MenuCacheType of the item */
+    guint size;                     /* Number of nodes inside a directory, which follow it directly */
+} CatalogNode;
+
+typedef struct
+{
+    gint ref;
+    MenuCache *cache;
+    gpointer reload_notify;
+    MenuCacheDir *root;             /* Root the nodes were made from - kept referenced, so a reload cannot hand back the same pointer */
+    GArray *nodes;                  /* CatalogNode for every visible menu item, depth first; NULL until the cache or a snapshot has loaded */
+    AppIndex *index;                /* Every app in the nodes, for search */
+    GHashTable *icons;              /* Icon store - for each size in use, a hash of icon name to stored icon */
+    GQueue lru;                     /* Stored icons holding a pixbuf, most recently used first */
+    gsize icon_bytes;               /* Bytes of pixel data held by the store */
+    gsize icon_budget;              /* Most bytes the store should hold, or 0 for no limit */
+    guint evictions;                /* Number of icons evicted to keep within the budget or trimmed */
+    guint redecodes;                /* Number of evicted icons which had to be decoded again */
+    guint icon_gen;                 /* Bumped whenever the store is cleared, so older acquisitions are not released */
+    GSList *listeners;
+    char *key;                      /* Locale and menu name, which a snapshot must have been made for */
+    gboolean from_snapshot;         /* Set while the nodes are from a snapshot which the menu cache has not yet confirmed */
+    gint64 stamp;                   /* Newest modification time of the menu cache files the nodes were made from */
+    gint64 load_start;              /* Time the menu cache was looked up */
+    gint64 ready_time;              /* Microseconds from lookup until the nodes were ready, or -1 until then */
+    gint64 build_time;              /* Microseconds taken to make the nodes and index from the last root or snapshot */
+} Catalog;
+
+/* Called when the nodes and index have been replaced, or the icons have to be looked up again */
+typedef void (*CatalogNotify) (gpointer data);
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+extern Catalog *catalog_ref (void);
+extern void catalog_unref (Catalog *cat);
+extern gpointer catalog_add_notify (Catalog *cat, CatalogNotify func, gpointer data);
+extern void catalog_remove_notify (Catalog *cat, gpointer notify_id);
+extern GdkPixbuf *catalog_icon (Catalog *cat, const char *name, int size);
+extern GdkPixbuf *catalog_icon_acquire (Catalog *cat, const char *name, int size, guint *gen);
+extern void catalog_icon_release (Catalog *cat, const char *name, int size, guint gen);
+extern void catalog_set_icon_budget (Catalog *cat, gsize bytes);
+extern void catalog_trim_icons (Catalog *cat);
+extern MenuCacheItem *catalog_find_item (const char *path);
+extern AppIndex *app_index_ref (AppIndex *index);
+extern void app_index_unref (AppIndex *index);
+
+#endif
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
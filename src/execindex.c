@@ -0,0 +1,991 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib-unix.h>
+
+#include "execindex.h"
+#include "trace.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+#define CACHE_MAGIC     0x534d5843
+#define CACHE_VERSION   2
+
+/* Most of the time goes waiting on the storage, so a few threads are enough to keep it busy */
+#define SCAN_THREADS    4
+
+/* Delay before changes seen by inotify are written back to the cache */
+#define SAVE_DELAY      5
+
+/* Interval between attempts to watch directories in PATH which do not exist */
+#define RETRY_DELAY     30
+
+/* Number of names a scanning thread collects before handing them to the main thread while loading */
+#define BATCH_SIZE      256
+
+#define WATCH_EVENTS    (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct
+{
+    ExecIndexNotify func;
+    gpointer data;
+} ExecListener;
+
+typedef struct
+{
+    const gint *cancel;             /* Set atomically by another thread to stop the scan */
+    gboolean stream;                /* Pass names to the main thread as they are found */
+} ExecScan;
+
+/* The cache file is a header, a table of directories, then NUL-terminated strings; offsets are from the start of the file */
+typedef struct
+{
+    guint32 magic;
+    guint32 version;
+    guint32 ndirs;
+    guint32 reserved;
+} CacheHeader;
+
+typedef struct
+{
+    gint64 mtime;
+    guint32 path;                   /* Offset of directory name */
+    guint32 names;                  /* Offset of first executable name */
+    guint32 count;                  /* Number of executable names */
+    guint32 nlinks;                 /* Number of those which are symbolic links, named again after the executables */
+} CacheDir;
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+/* The resident index lives while any plugin instance holds a reference, and is kept up to date with inotify */
+static gint users;
+static ExecIndex *resident;
+static gboolean loading;
+static GSList *listeners;
+static GHashTable *watches;
+static int inotify_fd = -1;
+static guint inotify_source;
+static guint save_timer;
+static guint retry_timer;
+
+/* Thread loading the resident index, the index once it has loaded, and the flag which stops it early */
+static GThread *load_thread;
+static ExecIndex *loaded;
+static gint cancel_load;
+
+/* Idle callbacks queued by the loading threads, so that they can be removed if the index is released first */
+static GMutex pending_lock;
+static GSList *pending;
+
+/* Names already passed to listeners while the resident index is loading */
+static GHashTable *streamed;
+
+/* Cleared when nobody is listening, so that the scanning threads do not build batches for no one */
+static gint streaming;
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static gboolean apply_batch (gpointer data);
+static void post_idle (GSourceFunc func, gpointer data, GDestroyNotify destroy);
+static gboolean watch_dir (ExecDir *dir);
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+static char *cache_path (void)
+{
+    return g_build_filename (g_get_user_cache_dir (), "smenu", "executables", NULL);
+}
+
+static gboolean dir_mtime (const char *path, gint64 *mtime)
+{
+    struct stat st;
+
+    if (stat (path, &st) < 0 || !S_ISDIR (st.st_mode)) return FALSE;
+    *mtime = st.st_mtim.tv_sec * G_GINT64_CONSTANT (1000000000) + st.st_mtim.tv_nsec;
+    return TRUE;
+}
+
+static gint compare_names (gconstpointer a, gconstpointer b)
+{
+    return strcmp (*(const char **) a, *(const char **) b);
+}
+
+static void exec_dir_free (ExecDir *dir)
+{
+    g_free (dir->path);
+    g_ptr_array_unref (dir->names);
+    if (dir->strings) g_string_chunk_free (dir->strings);
+    if (dir->links) g_hash_table_destroy (dir->links);
+    g_free (dir);
+}
+
+/* Records whether a name is a symbolic link; the name must stay valid for as long as the directory has it */
+
+static void exec_dir_set_link (ExecDir *dir, const char *name, gboolean link)
+{
+    if (link)
+    {
+        if (!dir->links) dir->links = g_hash_table_new (g_str_hash, g_str_equal);
+        g_hash_table_add (dir->links, (gpointer) name);
+    }
+    else if (dir->links) g_hash_table_remove (dir->links, name);
+}
+
+/* Find the names for a directory in the mapped cache, if its stamp still matches */
+
+static gboolean exec_dir_from_cache (ExecDir *dir, GMappedFile *cache)
+{
+    const char *data, *end, *name;
+    const CacheHeader *header;
+    const CacheDir *cdir;
+    gsize size;
+    guint32 i, j;
+
+    if (!cache) return FALSE;
+    data = g_mapped_file_get_contents (cache);
+    size = g_mapped_file_get_length (cache);
+    header = (const CacheHeader *) data;
+    end = data + size;
+
+    for (i = 0; i < header->ndirs; i++)
+    {
+        cdir = (const CacheDir *) (data + sizeof (CacheHeader)) + i;
+        if (cdir->path >= size || cdir->names > size || strcmp (data + cdir->path, dir->path)) continue;
+        if (cdir->mtime != dir->mtime) return FALSE;
+
+        name = data + cdir->names;
+        for (j = 0; j < cdir->count && name < end; j++)
+        {
+            g_ptr_array_add (dir->names, (gpointer) name);
+            name += strlen (name) + 1;
+        }
+        if (j != cdir->count) return FALSE;
+
+        for (j = 0; j < cdir->nlinks && name < end; j++)
+        {
+            exec_dir_set_link (dir, name, TRUE);
+            name += strlen (name) + 1;
+        }
+        return j == cdir->nlinks;
+    }
+    return FALSE;
+}
+
+/* Uses the type from the directory entry where it can, so regular files only need an access check. Sets link if the
+ * name is a symbolic link to an executable, so that looking up the app it runs knows to follow it. */
+
+static gboolean is_executable (int dfd, const char *name, unsigned char type, gboolean *link)
+{
+    struct stat st;
+
+    if (type == DT_UNKNOWN)
+    {
+        if (fstatat (dfd, name, &st, AT_SYMLINK_NOFOLLOW) < 0) return FALSE;
+        type = S_ISLNK (st.st_mode) ? DT_LNK : S_ISREG (st.st_mode) ? DT_REG : DT_UNKNOWN;
+    }
+
+    *link = FALSE;
+    switch (type)
+    {
+        case DT_REG :       break;
+
+        case DT_LNK :       if (fstatat (dfd, name, &st, 0) < 0 || !S_ISREG (st.st_mode)) return FALSE;
+                            *link = TRUE;
+                            break;
+
+        default :           return FALSE;
+    }
+    return faccessat (dfd, name, X_OK, 0) == 0;
+}
+
+/* Hand a batch of names to the main thread; the batch is freed either way */
+
+static void post_batch (GPtrArray *batch)
+{
+    if (batch->len && g_atomic_int_get (&streaming)) post_idle (apply_batch, batch, (GDestroyNotify) g_ptr_array_unref);
+    else g_ptr_array_unref (batch);
+}
+
+/* Queue a callback on the main thread from a loading thread */
+
+static void post_idle (GSourceFunc func, gpointer data, GDestroyNotify destroy)
+{
+    g_mutex_lock (&pending_lock);
+    pending = g_slist_prepend (pending, GUINT_TO_POINTER (g_idle_add_full (G_PRIORITY_DEFAULT_IDLE, func, data, destroy)));
+    g_mutex_unlock (&pending_lock);
+}
+
+/* Called at the start of each queued callback - the lock also makes sure the source id has been recorded */
+
+static void idle_done (void)
+{
+    guint id = g_source_get_id (g_main_current_source ());
+
+    g_mutex_lock (&pending_lock);
+    pending = g_slist_remove (pending, GUINT_TO_POINTER (id));
+    g_mutex_unlock (&pending_lock);
+}
+
+/* Runs in the scanning thread pool, one directory per call */
+
+static void exec_dir_scan (gpointer data, gpointer user_data)
+{
+    TRACE_BEGIN (start);
+    ExecDir *dir = (ExecDir *) data;
+    const ExecScan *scan = (const ExecScan *) user_data;
+    const gint *cancel = scan ? scan->cancel : NULL;
+    GPtrArray *batch = NULL;
+    struct dirent *ent;
+    gboolean link;
+    char *name;
+    DIR *ddir;
+    int dfd;
+
+    dir->strings = g_string_chunk_new (4096);
+    dfd = open (dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd < 0) return;
+    ddir = fdopendir (dfd);
+    if (!ddir)
+    {
+        close (dfd);
+        return;
+    }
+
+    while (!(cancel && g_atomic_int_get (cancel)) && (ent = readdir (ddir)))
+    {
+        if (ent->d_name[0] == '.' && (!ent->d_name[1] || (ent->d_name[1] == '.' && !ent->d_name[2]))) continue;
+        if (!is_executable (dfd, ent->d_name, ent->d_type, &link)) continue;
+
+        name = g_string_chunk_insert (dir->strings, ent->d_name);
+        g_ptr_array_add (dir->names, name);
+        if (link) exec_dir_set_link (dir, name, TRUE);
+        if (scan && scan->stream)
+        {
+            if (!batch) batch = g_ptr_array_new_full (BATCH_SIZE, g_free);
+            g_ptr_array_add (batch, g_strdup (name));
+            if (batch->len == BATCH_SIZE)
+            {
+                post_batch (batch);
+                batch = NULL;
+            }
+        }
+    }
+    closedir (ddir);
+    if (batch) post_batch (batch);
+
+    g_ptr_array_sort (dir->names, compare_names);
+    TRACE_END (start, "path_scan_dir");
+}
+
+static GMappedFile *cache_open (void)
+{
+    const CacheHeader *header;
+    GMappedFile *cache;
+    char *path = cache_path ();
+    gsize size;
+
+    cache = g_mapped_file_new (path, FALSE, NULL);
+    g_free (path);
+    if (!cache) return NULL;
+
+    /* the last byte must be a terminator, so that no string can run off the end */
+    header = (const CacheHeader *) g_mapped_file_get_contents (cache);
+    size = g_mapped_file_get_length (cache);
+    if (size < sizeof (CacheHeader) || header->magic != CACHE_MAGIC || header->version != CACHE_VERSION
+        || size < sizeof (CacheHeader) + header->ndirs * sizeof (CacheDir) || ((const char *) header)[size - 1])
+    {
+        g_mapped_file_unref (cache);
+        return NULL;
+    }
+    return cache;
+}
+
+/* Build the index for the current PATH. Directories whose modification time matches the cache are taken
+ * straight from the mapped file; if rescan is FALSE this fails unless every directory matched, otherwise
+ * the changed directories are read again. If stream is set, names are also passed to the main thread in
+ * batches as they are found, starting with those from the cache. */
+
+static ExecIndex *load_index (gboolean rescan, const gint *cancel, gboolean stream)
+{
+    TRACE_BEGIN (start);
+    ExecIndex *index;
+    ExecDir *dir;
+    ExecScan scan;
+    GPtrArray *stale, *batch;
+    GThreadPool *pool;
+    const char *env = g_getenv ("PATH");
+    gchar **dirnames, **dirname;
+    guint i, j;
+
+    index = g_new0 (ExecIndex, 1);
+    index->cache = cache_open ();
+    index->dirs = g_ptr_array_new_with_free_func ((GDestroyNotify) exec_dir_free);
+    if (!rescan && !index->cache)
+    {
+        exec_index_free (index);
+        TRACE_END (start, "path_load_failed");
+        return NULL;
+    }
+
+    stale = g_ptr_array_new ();
+    dirnames = g_strsplit (env ? env : "", G_SEARCHPATH_SEPARATOR_S, 0);
+    for (dirname = dirnames; *dirname && !(cancel && g_atomic_int_get (cancel)); dirname++)
+    {
+        dir = g_new0 (ExecDir, 1);
+        dir->path = g_strdup (*dirname);
+        dir->names = g_ptr_array_new ();
+        dir->wd = -1;
+        g_ptr_array_add (index->dirs, dir);
+
+        if (!**dirname || !dir_mtime (dir->path, &dir->mtime)) continue;
+        if (exec_dir_from_cache (dir, index->cache)) continue;
+
+        if (!rescan)
+        {
+            g_ptr_array_unref (stale);
+            g_strfreev (dirnames);
+            exec_index_free (index);
+            TRACE_END (start, "path_load_failed");
+            return NULL;
+        }
+        g_ptr_array_set_size (dir->names, 0);
+        g_ptr_array_add (stale, dir);
+    }
+    g_strfreev (dirnames);
+
+    /* whatever the cache already knows can be shown before any directory is read */
+    if (stream)
+    {
+        batch = g_ptr_array_new_with_free_func (g_free);
+        for (i = 0; i < index->dirs->len; i++)
+        {
+            dir = g_ptr_array_index (index->dirs, i);
+            for (j = 0; j < dir->names->len; j++) g_ptr_array_add (batch, g_strdup (g_ptr_array_index (dir->names, j)));
+        }
+        post_batch (batch);
+    }
+
+    /* scan the changed directories concurrently - freeing the pool waits for them all to finish */
+    if (stale->len)
+    {
+        scan.cancel = cancel;
+        scan.stream = stream;
+        pool = g_thread_pool_new (exec_dir_scan, &scan, MIN (stale->len, SCAN_THREADS), FALSE, NULL);
+        for (i = 0; i < stale->len; i++) g_thread_pool_push (pool, g_ptr_array_index (stale, i), NULL);
+        g_thread_pool_free (pool, FALSE, TRUE);
+        index->dirty = TRUE;
+    }
+    g_ptr_array_unref (stale);
+
+    TRACE_END (start, rescan ? "path_scan" : "path_load_cached");
+    return index;
+}
+
+ExecIndex *exec_index_load (gboolean rescan, const gint *cancel)
+{
+    return load_index (rescan, cancel, FALSE);
+}
+
+/* Write the index back to the cache if anything was rescanned */
+
+void exec_index_save (ExecIndex *index)
+{
+    GString *out;
+    CacheHeader header;
+    CacheDir cdir;
+    ExecDir *dir;
+    GHashTableIter iter;
+    gpointer link;
+    gsize table, off;
+    guint i, j;
+    char *path, *dirpath;
+
+    if (!index->dirty) return;
+
+    /* reserve the header and directory table, then fill them in once the string offsets are known */
+    table = sizeof (CacheHeader);
+    off = table + index->dirs->len * sizeof (CacheDir);
+    out = g_string_sized_new (off + 65536);
+    g_string_set_size (out, off);
+
+    for (i = 0; i < index->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (index->dirs, i);
+        memset (&cdir, 0, sizeof (CacheDir));
+        cdir.mtime = dir->mtime;
+        cdir.path = out->len;
+        g_string_append_len (out, dir->path, strlen (dir->path) + 1);
+        cdir.names = out->len;
+        cdir.count = dir->names->len;
+        for (j = 0; j < dir->names->len; j++)
+        {
+            const char *name = g_ptr_array_index (dir->names, j);
+            g_string_append_len (out, name, strlen (name) + 1);
+        }
+        if (dir->links)
+        {
+            cdir.nlinks = g_hash_table_size (dir->links);
+            g_hash_table_iter_init (&iter, dir->links);
+            while (g_hash_table_iter_next (&iter, &link, NULL)) g_string_append_len (out, link, strlen (link) + 1);
+        }
+        memcpy (out->str + table + i * sizeof (CacheDir), &cdir, sizeof (CacheDir));
+    }
+
+    memset (&header, 0, sizeof (CacheHeader));
+    header.magic = CACHE_MAGIC;
+    header.version = CACHE_VERSION;
+    header.ndirs = index->dirs->len;
+    memcpy (out->str, &header, sizeof (CacheHeader));
+
+    path = cache_path ();
+    dirpath = g_path_get_dirname (path);
+    g_mkdir_with_parents (dirpath, 0700);
+    g_file_set_contents (path, out->str, out->len, NULL);
+    g_free (dirpath);
+    g_free (path);
+    g_string_free (out, TRUE);
+    index->dirty = FALSE;
+}
+
+void exec_index_free (ExecIndex *index)
+{
+    if (index->all) g_hash_table_destroy (index->all);
+    g_ptr_array_unref (index->dirs);
+    if (index->cache) g_mapped_file_unref (index->cache);
+    g_free (index);
+}
+
+/* All names, with those shadowed by an earlier directory in PATH removed */
+
+GPtrArray *exec_index_names (ExecIndex *index)
+{
+    GHashTable *seen = g_hash_table_new (g_str_hash, g_str_equal);
+    GPtrArray *names = g_ptr_array_new ();
+    ExecDir *dir;
+    guint i, j;
+
+    for (i = 0; i < index->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (index->dirs, i);
+        for (j = 0; j < dir->names->len; j++)
+            if (g_hash_table_add (seen, g_ptr_array_index (dir->names, j)))
+                g_ptr_array_add (names, g_ptr_array_index (dir->names, j));
+    }
+    g_hash_table_destroy (seen);
+    return names;
+}
+
+/* Resident index */
+
+static void notify_listeners (const char *name, gboolean added)
+{
+    ExecListener *l;
+    GSList *item;
+
+    for (item = listeners; item; item = item->next)
+    {
+        l = (ExecListener *) item->data;
+        l->func (name, added, l->data);
+    }
+}
+
+static gboolean save_resident (G_GNUC_UNUSED gpointer data)
+{
+    save_timer = 0;
+    if (resident) exec_index_save (resident);
+    return FALSE;
+}
+
+static void resident_changed (ExecDir *dir)
+{
+    dir_mtime (dir->path, &dir->mtime);
+    resident->dirty = TRUE;
+    if (!save_timer) save_timer = g_timeout_add_seconds (SAVE_DELAY, save_resident, NULL);
+}
+
+/* Binary search of a directory's sorted names - returns TRUE if found, with pos set to where it is or would go */
+
+static gboolean dir_find (ExecDir *dir, const char *name, guint *pos)
+{
+    guint lo = 0, hi = dir->names->len, mid;
+    int res;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        res = strcmp (g_ptr_array_index (dir->names, mid), name);
+        if (!res)
+        {
+            *pos = mid;
+            return TRUE;
+        }
+        if (res < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *pos = lo;
+    return FALSE;
+}
+
+static void resident_add (ExecDir *dir, const char *name, gboolean link)
+{
+    guint pos, count;
+    char *str;
+
+    /* a name already there may have been replaced by or with a symbolic link */
+    if (dir_find (dir, name, &pos))
+    {
+        exec_dir_set_link (dir, g_ptr_array_index (dir->names, pos), link);
+        return;
+    }
+    if (!dir->strings) dir->strings = g_string_chunk_new (1024);
+    str = g_string_chunk_insert (dir->strings, name);
+    g_ptr_array_insert (dir->names, pos, str);
+    exec_dir_set_link (dir, str, link);
+
+    /* an existing key is kept, so the name is only announced the first time it appears anywhere in PATH */
+    count = GPOINTER_TO_UINT (g_hash_table_lookup (resident->all, str));
+    g_hash_table_insert (resident->all, str, GUINT_TO_POINTER (count + 1));
+    if (!count) notify_listeners (str, TRUE);
+}
+
+static void resident_remove (ExecDir *dir, const char *name)
+{
+    guint pos, count;
+
+    if (!dir_find (dir, name, &pos)) return;
+    exec_dir_set_link (dir, name, FALSE);
+    g_ptr_array_remove_index (dir->names, pos);
+
+    /* names are never freed from a directory's storage, so the key stays valid until it is removed */
+    count = GPOINTER_TO_UINT (g_hash_table_lookup (resident->all, name));
+    if (count > 1) g_hash_table_insert (resident->all, (gpointer) name, GUINT_TO_POINTER (count - 1));
+    else
+    {
+        g_hash_table_remove (resident->all, name);
+        notify_listeners (name, FALSE);
+    }
+}
+
+/* Bring a directory back in line with the disk, for when events may have been missed */
+
+static void resident_resync (ExecDir *dir)
+{
+    ExecDir *fresh = g_new0 (ExecDir, 1);
+    GPtrArray *gone = g_ptr_array_new ();
+    const char *name;
+    guint i, pos;
+
+    fresh->path = g_strdup (dir->path);
+    fresh->names = g_ptr_array_new ();
+    exec_dir_scan (fresh, NULL);
+
+    for (i = 0; i < dir->names->len; i++)
+        if (!dir_find (fresh, g_ptr_array_index (dir->names, i), &pos)) g_ptr_array_add (gone, g_ptr_array_index (dir->names, i));
+    for (i = 0; i < gone->len; i++) resident_remove (dir, g_ptr_array_index (gone, i));
+    for (i = 0; i < fresh->names->len; i++)
+    {
+        name = g_ptr_array_index (fresh->names, i);
+        resident_add (dir, name, fresh->links && g_hash_table_contains (fresh->links, name));
+    }
+
+    g_ptr_array_unref (gone);
+    exec_dir_free (fresh);
+    resident_changed (dir);
+}
+
+/* A directory which cannot be watched, because it does not exist yet or has gone, is tried again every RETRY_DELAY
+ * seconds until it can be */
+
+static gboolean retry_watches (G_GNUC_UNUSED gpointer data)
+{
+    ExecDir *dir;
+    gboolean missing = FALSE;
+    guint i;
+
+    for (i = 0; i < resident->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (resident->dirs, i);
+        if (dir->wd >= 0 || !*dir->path) continue;
+
+        /* anything already found in it will have been removed when the watch was lost */
+        if (watch_dir (dir)) resident_resync (dir);
+        else missing = TRUE;
+    }
+
+    if (!missing) retry_timer = 0;
+    return missing;
+}
+
+static gboolean watch_dir (ExecDir *dir)
+{
+    dir->wd = inotify_add_watch (inotify_fd, dir->path, WATCH_EVENTS | IN_ONLYDIR);
+    if (dir->wd >= 0)
+    {
+        g_hash_table_insert (watches, GINT_TO_POINTER (dir->wd), dir);
+        return TRUE;
+    }
+
+    if (!retry_timer) retry_timer = g_timeout_add_seconds (RETRY_DELAY, retry_watches, NULL);
+    return FALSE;
+}
+
+static gboolean handle_inotify (gint fd, G_GNUC_UNUSED GIOCondition cond, G_GNUC_UNUSED gpointer data)
+{
+    char buf[4096] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+    const struct inotify_event *ev;
+    ExecDir *dir;
+    gboolean link;
+    ssize_t len;
+    char *p, *path;
+    guint i;
+
+    while ((len = read (fd, buf, sizeof (buf))) > 0)
+    {
+        for (p = buf; p < buf + len; p += sizeof (struct inotify_event) + ev->len)
+        {
+            ev = (const struct inotify_event *) p;
+
+            if (ev->mask & IN_Q_OVERFLOW)
+            {
+                for (i = 0; i < resident->dirs->len; i++) resident_resync (g_ptr_array_index (resident->dirs, i));
+                continue;
+            }
+
+            dir = g_hash_table_lookup (watches, GINT_TO_POINTER (ev->wd));
+            if (!dir) continue;
+
+            if (ev->mask & IN_IGNORED)
+            {
+                /* the directory itself has gone - or was replaced, in which case the new one is watched straight away */
+                g_hash_table_remove (watches, GINT_TO_POINTER (ev->wd));
+                watch_dir (dir);
+                resident_resync (dir);
+                continue;
+            }
+            if (ev->mask & IN_MOVE_SELF)
+            {
+                /* the watch follows the directory to its new name, so drop it; IN_IGNORED then looks at the old path */
+                inotify_rm_watch (fd, ev->wd);
+                continue;
+            }
+            if (!ev->len) continue;
+
+            if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) resident_remove (dir, ev->name);
+            else
+            {
+                /* new files and permission changes both need the executable test */
+                path = g_build_filename (dir->path, ev->name, NULL);
+                if (is_executable (AT_FDCWD, path, DT_UNKNOWN, &link)) resident_add (dir, ev->name, link);
+                else resident_remove (dir, ev->name);
+                g_free (path);
+            }
+            resident_changed (dir);
+        }
+    }
+    return G_SOURCE_CONTINUE;
+}
+
+/* Runs on the main thread for each batch of names found while the resident index is loading */
+
+static gboolean apply_batch (gpointer data)
+{
+    GPtrArray *batch = (GPtrArray *) data;
+    char *name;
+    guint i;
+
+    idle_done ();
+
+    /* once loading has finished, the final index has already been reconciled with the listeners */
+    if (!streamed) return FALSE;
+
+    for (i = 0; i < batch->len; i++)
+    {
+        name = g_ptr_array_index (batch, i);
+        if (g_hash_table_contains (streamed, name)) continue;
+
+        /* the set takes ownership of the name */
+        batch->pdata[i] = NULL;
+        g_hash_table_add (streamed, name);
+        notify_listeners (name, TRUE);
+    }
+    return FALSE;
+}
+
+static void make_resident (ExecIndex *index)
+{
+    GHashTableIter iter;
+    gpointer key;
+    ExecDir *dir;
+    gint64 mtime;
+    guint i, j;
+
+    resident = index;
+    loading = FALSE;
+
+    index->all = g_hash_table_new (g_str_hash, g_str_equal);
+    for (i = 0; i < index->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (index->dirs, i);
+        for (j = 0; j < dir->names->len; j++)
+        {
+            gpointer name = g_ptr_array_index (dir->names, j);
+            g_hash_table_insert (index->all, name, GUINT_TO_POINTER (GPOINTER_TO_UINT (g_hash_table_lookup (index->all, name)) + 1));
+        }
+    }
+
+    /* bring listeners that followed the load in line with the final index */
+    if (streamed)
+    {
+        g_hash_table_iter_init (&iter, streamed);
+        while (g_hash_table_iter_next (&iter, &key, NULL))
+            if (!g_hash_table_contains (index->all, key)) notify_listeners (key, FALSE);
+        g_hash_table_iter_init (&iter, index->all);
+        while (g_hash_table_iter_next (&iter, &key, NULL))
+            if (!g_hash_table_contains (streamed, key)) notify_listeners (key, TRUE);
+        g_hash_table_destroy (streamed);
+        streamed = NULL;
+    }
+
+    inotify_fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) return;
+    inotify_source = g_unix_fd_add (inotify_fd, G_IO_IN, handle_inotify, NULL);
+    watches = g_hash_table_new (NULL, NULL);
+
+    for (i = 0; i < index->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (index->dirs, i);
+        if (!*dir->path || !watch_dir (dir)) continue;
+
+        /* catch anything which changed between the scan and the watch being added */
+        if (dir_mtime (dir->path, &mtime) && mtime != dir->mtime) resident_resync (dir);
+    }
+}
+
+static gboolean load_finished (G_GNUC_UNUSED gpointer data)
+{
+    idle_done ();
+    g_thread_join (load_thread);
+    load_thread = NULL;
+    make_resident (loaded);
+    loaded = NULL;
+    return FALSE;
+}
+
+static gpointer load_index_thread (G_GNUC_UNUSED gpointer data)
+{
+    ExecIndex *index = load_index (TRUE, &cancel_load, TRUE);
+
+    if (g_atomic_int_get (&cancel_load))
+    {
+        exec_index_free (index);
+        return NULL;
+    }
+
+    exec_index_save (index);
+    loaded = index;
+    post_idle (load_finished, NULL, NULL);
+    return NULL;
+}
+
+/* Returns the resident index, or NULL if it is still being loaded - listeners are sent names as they are found */
+
+ExecIndex *exec_index_get (void)
+{
+    ExecIndex *index;
+
+    if (resident || loading) return resident;
+
+    /* if the cache is good, no thread is needed */
+    index = exec_index_load (FALSE, NULL);
+    if (index)
+    {
+        make_resident (index);
+        return resident;
+    }
+
+    loading = TRUE;
+    streamed = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+    load_thread = g_thread_new ("exec-index", load_index_thread, NULL);
+    return NULL;
+}
+
+/* Each plugin instance holds a reference while it may use the resident index; the last one to go stops the loading
+ * and the watches, so that nothing is left to call into the module once it is unloaded */
+
+void exec_index_ref (void)
+{
+    users++;
+}
+
+void exec_index_unref (void)
+{
+    GSList *item;
+
+    if (--users) return;
+
+    /* wait for any load to give up, then drop whatever it queued for the main thread */
+    if (load_thread)
+    {
+        g_atomic_int_set (&cancel_load, 1);
+        g_thread_join (load_thread);
+        load_thread = NULL;
+        g_atomic_int_set (&cancel_load, 0);
+    }
+    g_mutex_lock (&pending_lock);
+    for (item = pending; item; item = item->next) g_source_remove (GPOINTER_TO_UINT (item->data));
+    g_slist_free (pending);
+    pending = NULL;
+    g_mutex_unlock (&pending_lock);
+    if (loaded) exec_index_free (loaded);
+    loaded = NULL;
+    loading = FALSE;
+    if (streamed) g_hash_table_destroy (streamed);
+    streamed = NULL;
+
+    if (retry_timer) g_source_remove (retry_timer);
+    retry_timer = 0;
+    if (inotify_source) g_source_remove (inotify_source);
+    inotify_source = 0;
+    if (inotify_fd >= 0) close (inotify_fd);
+    inotify_fd = -1;
+    if (watches) g_hash_table_destroy (watches);
+    watches = NULL;
+
+    /* changes not yet written back are saved now rather than lost */
+    if (save_timer)
+    {
+        g_source_remove (save_timer);
+        save_timer = 0;
+        exec_index_save (resident);
+    }
+    if (resident) exec_index_free (resident);
+    resident = NULL;
+}
+
+/* The directory of the first PATH entry that contains the named executable, or NULL, with link set if it is a symbolic
+ * link there - no files are touched */
+
+const char *exec_index_find (ExecIndex *index, const char *name, gboolean *link)
+{
+    ExecDir *dir;
+    guint i, pos;
+
+    if (index->all && !g_hash_table_contains (index->all, name)) return NULL;
+    for (i = 0; i < index->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (index->dirs, i);
+        if (dir_find (dir, name, &pos))
+        {
+            *link = dir->links && g_hash_table_contains (dir->links, name);
+            return dir->path;
+        }
+    }
+    return NULL;
+}
+
+/* Up to max names starting with prefix, sorted, with those shadowed by an earlier directory removed - each
+ * directory is sorted, so this is a binary search per directory */
+
+GPtrArray *exec_index_prefix (ExecIndex *index, const char *prefix, guint max)
+{
+    GHashTable *seen = g_hash_table_new (g_str_hash, g_str_equal);
+    GPtrArray *names = g_ptr_array_new ();
+    gsize len = strlen (prefix);
+    ExecDir *dir;
+    const char *name;
+    guint i, pos;
+
+    for (i = 0; i < index->dirs->len; i++)
+    {
+        dir = g_ptr_array_index (index->dirs, i);
+        for (dir_find (dir, prefix, &pos); pos < dir->names->len; pos++)
+        {
+            name = g_ptr_array_index (dir->names, pos);
+            if (strncmp (name, prefix, len)) break;
+            if (g_hash_table_add (seen, (gpointer) name)) g_ptr_array_add (names, (gpointer) name);
+        }
+    }
+    g_hash_table_destroy (seen);
+
+    g_ptr_array_sort (names, compare_names);
+    if (names->len > max) g_ptr_array_set_size (names, max);
+    return names;
+}
+
+/* The new listener is first sent every name known so far, so it does not need to fill itself from the index */
+
+gpointer exec_index_add_notify (ExecIndexNotify func, gpointer data)
+{
+    ExecListener *l = g_new0 (ExecListener, 1);
+    GHashTableIter iter;
+    GPtrArray *names;
+    gpointer key;
+    guint i;
+
+    l->func = func;
+    l->data = data;
+    listeners = g_slist_prepend (listeners, l);
+    g_atomic_int_set (&streaming, 1);
+
+    if (resident)
+    {
+        names = exec_index_names (resident);
+        for (i = 0; i < names->len; i++) func (g_ptr_array_index (names, i), TRUE, data);
+        g_ptr_array_unref (names);
+    }
+    else if (streamed)
+    {
+        g_hash_table_iter_init (&iter, streamed);
+        while (g_hash_table_iter_next (&iter, &key, NULL)) func (key, TRUE, data);
+    }
+    return l;
+}
+
+void exec_index_remove_notify (gpointer notify_id)
+{
+    listeners = g_slist_remove (listeners, notify_id);
+    g_free (notify_id);
+    if (!listeners) g_atomic_int_set (&streaming, 0);
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
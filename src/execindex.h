@@ -0,0 +1,75 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#ifndef EXECINDEX_H
+#define EXECINDEX_H
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+typedef struct
+{
+    char *path;                     /* Directory from PATH */
+    gint64 mtime;                   /* Modification time of the directory, in ns */
+    GPtrArray *names;               /* Executables in the directory, sorted */
+    GStringChunk *strings;          /* Storage for names if scanned, NULL if they point into the cache */
+    GHashTable *links;              /* Names which are symbolic links, or NULL if there are none */
+    int wd;                         /* inotify watch, or -1 */
+} ExecDir;
+
+typedef struct
+{
+    GMappedFile *cache;             /* Mapped cache file */
+    GPtrArray *dirs;                /* ExecDir for each directory in PATH, in order */
+    gboolean dirty;                 /* Set if any directory had to be rescanned */
+    GHashTable *all;                /* Number of directories containing each name, once resident */
+} ExecIndex;
+
+/* Called with each name added to or removed from the resident index, including those found while it loads */
+typedef void (*ExecIndexNotify) (const char *name, gboolean added, gpointer data);
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+extern ExecIndex *exec_index_load (gboolean rescan, const gint *cancel);
+extern void exec_index_save (ExecIndex *index);
+extern void exec_index_free (ExecIndex *index);
+extern GPtrArray *exec_index_names (ExecIndex *index);
+extern void exec_index_ref (void);
+extern void exec_index_unref (void);
+extern ExecIndex *exec_index_get (void);
+extern const char *exec_index_find (ExecIndex *index, const char *name, gboolean *link);
+extern GPtrArray *exec_index_prefix (ExecIndex *index, const char *prefix, guint max);
+extern gpointer exec_index_add_notify (ExecIndexNotify func, gpointer data);
+extern void exec_index_remove_notify (gpointer notify_id);
+
+#endif
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
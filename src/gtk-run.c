@@ -46,93 +46,142 @@
 #include "lxutils.h"
 #endif
 
+#include "execindex.h"
+#include "history.h"
+#include "applaunch.h"
+#include "trace.h"
+
 static GtkWidget* win = NULL; /* the run dialog */
+static guint win_gen = 0; /* bumped whenever the dialog closes, so a launch can tell if its dialog is still open */
 #ifndef DISABLE_MENU
-static MenuCache* menu_cache = NULL;
-static GSList* app_list = NULL; /* all known apps in menu cache */
+static MenuCache* menu_cache = NULL; /* shared with the menu plugin */
+static GSList* app_list = NULL; /* all known apps in menu cache, loaded when the dialog first needs them */
 static gpointer reload_notify_id = NULL;
 #endif
 
-typedef struct _ThreadData
-{
-    gboolean cancel; /* is the loading cancelled */
-    GSList* files; /* all executable files found */
-    GtkEntry* entry;
-}ThreadData;
+#define COMPLETION_MIN_KEY 2
 
-static ThreadData* thread_data = NULL; /* thread data used to load availble programs in PATH */
+static GtkListStore* completion_store = NULL; /* completion model, holding only the names that match the entry */
+static GtkEntry* completion_entry = NULL;
+static GPtrArray* exec_names = NULL; /* every executable, kept in step with the executable index */
+static gboolean exec_names_sorted = FALSE; /* names are sorted lazily, as the index sends them in bulk */
+static guint refill_idle = 0;
+static gpointer exec_notify_id = NULL;
+static CommandHistory* command_history = NULL; /* command lines run before, mapped while any plugin is loaded */
 
 #ifndef DISABLE_MENU
-static MenuCacheApp* match_app_by_exec(const char* exec)
+typedef struct _AppExec
 {
-    GSList* l;
-    MenuCacheApp* ret = NULL;
-    char* exec_path = g_find_program_in_path(exec);
-    const char* pexec;
-    int path_len, exec_len, len;
+    MenuCacheApp* app;
+    int rank; /* 0: no arguments, 1: a file or URL field code, 2: other arguments */
+}AppExec;
 
-    if( ! exec_path )
-        return NULL;
+static GHashTable* app_by_exec = NULL; /* best AppExec for each program, by absolute path or bare name */
+static GHashTable* resolved = NULL; /* memoised app for each typed command, NULL if there is none */
+static guint resolve_idle = 0;
+static GtkEntry* resolve_entry = NULL;
 
-    path_len = strlen(exec_path);
-    exec_len = strlen(exec);
+#define ICON_CACHE_SIZE 16
+
+typedef struct _IconCacheEntry
+{
+    char* name;
+    GdkPixbuf* pix;
+}IconCacheEntry;
+
+/* decoded dialog-size icons, most recently used first, so typing through a command never rasterises an icon twice */
+static IconCacheEntry icon_cache[ICON_CACHE_SIZE];
+static gulong icon_theme_handler = 0;
+static MenuCacheApp* shown_app = NULL; /* app whose icon is in the dialog, valid if icon_shown is set */
+static gboolean icon_shown = FALSE;
+
+static void app_exec_free(AppExec* ae)
+{
+    g_slice_free(AppExec, ae);
+}
+
+/* index app_list by program, so that matching a command is a hash lookup */
+static void build_app_index(void)
+{
+    GSList* l;
+    AppExec* ae;
+    char** argv;
+    int argc, rank;
+
+    app_by_exec = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, (GDestroyNotify)app_exec_free);
+    resolved = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
 
     for( l = app_list; l; l = l->next )
     {
         MenuCacheApp* app = MENU_CACHE_APP(l->data);
         const char* app_exec = menu_cache_app_get_exec(app);
-        if ( ! app_exec)
+        if( ! app_exec || ! g_shell_parse_argv(app_exec, &argc, &argv, NULL) )
             continue;
-#if 0   /* This is useless and incorrect. */
-        /* Dirty hacks to skip sudo programs. This can be a little bit buggy */
-        if( g_str_has_prefix(app_exec, "gksu") )
-        {
-            app_exec += 4;
-            if( app_exec[0] == '\0' ) /* "gksu" itself */
-                app_exec -= 4;
-            else if( app_exec[0] == ' ' ) /* "gksu something..." */
-                ++app_exec;
-            else if( g_str_has_prefix(app_exec, "do ") ) /* "gksudo something" */
-                app_exec += 3;
-        }
-        else if( g_str_has_prefix(app_exec, "kdesu ") ) /* kdesu */
-            app_exec += 6;
-#endif
 
-        if( g_path_is_absolute(app_exec) )
-        {
-            pexec = exec_path;
-            len = path_len;
-        }
+        if( argc == 1 )
+            rank = 0;
+        else if( argv[1][0] == '%' && argv[1][1] && strchr( "FfUu", argv[1][1] ) && ! argv[1][2] )
+            rank = 1;
         else
+            rank = 2;
+
+        /* on a tie the app listed first wins */
+        ae = g_hash_table_lookup(app_by_exec, argv[0]);
+        if( ! ae )
         {
-            pexec = exec;
-            len = exec_len;
+            ae = g_slice_new0(AppExec);
+            ae->rank = G_MAXINT;
+            g_hash_table_insert(app_by_exec, g_strdup(argv[0]), ae);
         }
-
-        if( strncmp(app_exec, pexec, len) == 0 )
+        if( rank < ae->rank )
         {
-            /* exact match has the highest priority */
-            if( app_exec[len] == '\0' )
-            {
-                ret = app;
-                break;
-            }
-            /* those matches the pattern: exe_name %F|%f|%U|%u have higher priority */
-            if( app_exec[len] == ' ' )
-            {
-                if( app_exec[len + 1] == '%' )
-                {
-                    if( strchr( "FfUu", app_exec[len + 2] ) )
-                    {
-                        ret = app;
-                        break;
-                    }
-                }
-                ret = app;
-            }
+            ae->app = app;
+            ae->rank = rank;
         }
+        g_strfreev(argv);
+    }
+}
+
+static void free_app_index(void)
+{
+    if( resolve_idle )
+    {
+        g_source_remove(resolve_idle);
+        resolve_idle = 0;
     }
+    if( app_by_exec )
+    {
+        g_hash_table_destroy(app_by_exec);
+        app_by_exec = NULL;
+    }
+    if( resolved )
+    {
+        g_hash_table_destroy(resolved);
+        resolved = NULL;
+    }
+}
+
+/* an app run by its bare name has priority over one run by its full path only if it ranks as well */
+static MenuCacheApp* lookup_app_by_exec(const char* exec, const char* exec_path)
+{
+    AppExec* by_name = g_hash_table_lookup(app_by_exec, exec);
+    AppExec* by_path = g_hash_table_lookup(app_by_exec, exec_path);
+
+    if( by_name && ( ! by_path || by_name->rank <= by_path->rank ) )
+        return by_name->app;
+    return by_path ? by_path->app : NULL;
+}
+
+static MenuCacheApp* match_app_by_exec(const char* exec)
+{
+    MenuCacheApp* ret;
+    char* exec_path = g_find_program_in_path(exec);
+    int len;
+
+    if( ! exec_path )
+        return NULL;
+
+    ret = lookup_app_by_exec(exec, exec_path);
 
     /* if this is a symlink */
     if( ! ret && g_file_test(exec_path, G_FILE_TEST_IS_SYMLINK) )
@@ -162,184 +211,431 @@ static MenuCacheApp* match_app_by_exec(const char* exec)
     g_free(exec_path);
     return ret;
 }
-#endif
 
-static void setup_auto_complete_with_data(ThreadData* data)
+/* Called for every keystroke, so this only looks in the tables and the resident executable index.
+ * Returns FALSE if the answer needs the file system, which is only for a path or a symlink with no
+ * app of its own. Until the index has loaded, nothing is matched. */
+static gboolean find_app_by_exec(const char* exec, MenuCacheApp** app)
 {
-    GtkListStore* store;
-    GSList *l;
-    GtkEntryCompletion* comp = gtk_entry_completion_new();
-    gtk_entry_completion_set_minimum_key_length( comp, 2 );
-    gtk_entry_completion_set_inline_completion( comp, TRUE );
-    gtk_entry_completion_set_popup_set_width( comp, TRUE );
-    gtk_entry_completion_set_popup_single_match( comp, FALSE );
-    store = gtk_list_store_new( 1, G_TYPE_STRING );
+    ExecIndex* index;
+    const char* dir;
+    char* exec_path;
+    gboolean link;
+    gpointer val;
 
-    for( l = data->files; l; l = l->next )
+    if( g_hash_table_lookup_extended(resolved, exec, NULL, &val) )
     {
-        const char *name = (const char*)l->data;
-        GtkTreeIter it;
-        gtk_list_store_append( store, &it );
-        gtk_list_store_set( store, &it, 0, name, -1 );
+        *app = val;
+        return TRUE;
     }
 
-    gtk_entry_completion_set_model( comp, (GtkTreeModel*)store );
-    g_object_unref( store );
-    gtk_entry_completion_set_text_column( comp, 0 );
-    gtk_entry_set_completion( (GtkEntry*)data->entry, comp );
+    if( strchr(exec, '/') )
+        return FALSE;
 
-    /* trigger entry completion */
-    gtk_entry_completion_complete(comp);
-    g_object_unref( comp );
+    index = exec_index_get();
+    if( ! index )
+    {
+        *app = NULL;
+        return TRUE;
+    }
+
+    dir = exec_index_find(index, exec, &link);
+    if( dir )
+    {
+        exec_path = g_build_filename(dir, exec, NULL);
+        *app = lookup_app_by_exec(exec, exec_path);
+        g_free(exec_path);
+        if( ! *app && link ) /* it may still point to one */
+            return FALSE;
+    }
+    else /* not in PATH */
+        *app = NULL;
+
+    g_hash_table_insert(resolved, g_strdup(exec), *app);
+    return TRUE;
 }
+#endif
 
-static void thread_data_free(ThreadData* data)
+static gint compare_names(gconstpointer a, gconstpointer b)
 {
-    g_slist_foreach(data->files, (GFunc)g_free, NULL);
-    g_slist_free(data->files);
-    g_slice_free(ThreadData, data);
+    return strcmp( *(const char**)a, *(const char**)b );
 }
 
-static gboolean on_thread_finished(ThreadData* data)
+/* Binary search the sorted names comparing only the first len bytes, so that all names starting with
+ * prefix lie between the lower and the upper bound */
+static guint bound_names(const char* prefix, gsize len, gboolean upper)
 {
-    /* don't setup entry completion if the thread is already cancelled. */
-    if( !data->cancel )
-        setup_auto_complete_with_data(thread_data);
-    thread_data_free(data);
-    thread_data = NULL; /* global thread_data pointer */
-    return FALSE;
+    guint lo = 0, hi, mid;
+    int res;
+
+    if( ! exec_names_sorted )
+    {
+        g_ptr_array_sort( exec_names, compare_names );
+        exec_names_sorted = TRUE;
+    }
+
+    hi = exec_names->len;
+    while( lo < hi )
+    {
+        mid = ( lo + hi ) / 2;
+        res = strncmp( g_ptr_array_index( exec_names, mid ), prefix, len );
+        if( res < 0 || ( upper && res == 0 ) )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
 }
 
-static gpointer thread_func(ThreadData* data)
+/* fill the completion model with the commands run before and then the slice of names that start with the entry text */
+static void refill_completion_store(void)
 {
-    GSList *list = NULL;
-    gchar **dirname;
-    gchar **dirnames = g_strsplit( g_getenv("PATH"), ":", 0 );
+    TRACE_BEGIN( start );
+    const char* prefix = gtk_entry_get_text( completion_entry );
+    gsize len = strlen( prefix );
+    GPtrArray* history;
+    guint first, last, i;
+    const char* name;
+
+    gtk_list_store_clear( completion_store );
+    if( len < COMPLETION_MIN_KEY )
+    {
+        TRACE_END( start, "run_completion" );
+        return;
+    }
+
+    history = command_history_match( command_history, prefix );
+    for( i = 0; i < history->len; ++i )
+        gtk_list_store_insert_with_values( completion_store, NULL, -1, 0, g_ptr_array_index( history, i ), -1 );
 
-    for( dirname = dirnames; !thread_data->cancel && *dirname; ++dirname )
+    first = bound_names( prefix, len, FALSE );
+    last = bound_names( prefix, len, TRUE );
+    for( ; first < last; ++first )
     {
-        GDir *dir = g_dir_open( *dirname, 0, NULL );
-        const char *name;
-        if( ! dir )
-            continue;
-        while( !thread_data->cancel && (name = g_dir_read_name(dir)) )
-        {
-            char* filename = g_build_filename( *dirname, name, NULL );
-            if( g_file_test( filename, G_FILE_TEST_IS_EXECUTABLE ) )
-            {
-                if(thread_data->cancel)
-                    break;
-                if( !g_slist_find_custom( list, name, (GCompareFunc)strcmp ) )
-                    list = g_slist_prepend( list, g_strdup( name ) );
-            }
-            g_free( filename );
-        }
-        g_dir_close( dir );
+        /* there are at most a few dozen history matches, so checking them all is cheap */
+        name = g_ptr_array_index( exec_names, first );
+        for( i = 0; i < history->len; ++i )
+            if( ! strcmp( g_ptr_array_index( history, i ), name ) )
+                break;
+        if( i == history->len )
+            gtk_list_store_insert_with_values( completion_store, NULL, -1, 0, name, -1 );
     }
-    g_strfreev( dirnames );
+    g_ptr_array_unref( history );
+    TRACE_END( start, "run_completion" );
+}
 
-    data->files = list;
-    /* install an idle handler to free associated data */
-    g_idle_add((GSourceFunc)on_thread_finished, data);
-#if GLIB_CHECK_VERSION(2, 32, 0)
-    g_thread_unref(g_thread_self());
-#endif
+static gboolean on_refill_idle(gpointer user_data)
+{
+    refill_idle = 0;
+    refill_completion_store();
+    return FALSE;
+}
+
+/* connected before the completion's own handler, so the model is ready by the time it is filtered */
+static void on_completion_entry_changed(GtkEntry* entry, gpointer user_data)
+{
+    if( refill_idle )
+    {
+        g_source_remove( refill_idle );
+        refill_idle = 0;
+    }
+    refill_completion_store();
+}
 
-    return NULL;
+/* the model only ever holds matches */
+static gboolean match_completion(GtkEntryCompletion* comp, const gchar* key, GtkTreeIter* iter, gpointer user_data)
+{
+    return TRUE;
 }
 
-static void setup_auto_complete( GtkEntry* entry )
+static void on_exec_index_changed(const char* name, gboolean added, gpointer user_data)
 {
-    gboolean cache_is_available = FALSE;
-    /* FIXME: consider saving the list of commands as on-disk cache. */
-    if( cache_is_available )
+    gsize len = strlen( name ) + 1;
+    guint pos;
+
+    if( added )
     {
-        /* load cached program list */
+        g_ptr_array_add( exec_names, g_strdup( name ) );
+        exec_names_sorted = FALSE;
     }
     else
     {
-        /* load in another working thread */
-        thread_data = g_slice_new0(ThreadData); /* the data will be freed in idle handler later. */
-        thread_data->entry = entry;
-#if GLIB_CHECK_VERSION(2, 32, 0)
-        g_thread_new("gtk-run-autocomplete", (GThreadFunc)thread_func, thread_data);
-        /* we don't use loader_thread_id but Glib 2.32 crashes if we unref
-           GThread while it's in creation progress. It is a bug of GLib
-           certainly but as workaround we'll unref it in the thread itself */
-#else
-        g_thread_create((GThreadFunc)thread_func, thread_data, FALSE, NULL);
-#endif
+        /* comparing the terminator as well makes this an exact match */
+        pos = bound_names( name, len, FALSE );
+        if( pos < exec_names->len && ! strcmp( g_ptr_array_index( exec_names, pos ), name ) )
+            g_ptr_array_remove_index( exec_names, pos );
     }
+
+    /* names may arrive in large batches while PATH is scanned, so the model is refilled once they stop */
+    if( ! refill_idle && strlen( gtk_entry_get_text( completion_entry ) ) >= COMPLETION_MIN_KEY )
+        refill_idle = g_idle_add( on_refill_idle, NULL );
+}
+
+static void setup_auto_complete( GtkEntry* entry )
+{
+    GtkEntryCompletion* comp = gtk_entry_completion_new();
+    gtk_entry_completion_set_minimum_key_length( comp, COMPLETION_MIN_KEY );
+    gtk_entry_completion_set_inline_completion( comp, TRUE );
+    gtk_entry_completion_set_popup_set_width( comp, TRUE );
+    gtk_entry_completion_set_popup_single_match( comp, FALSE );
+    gtk_entry_completion_set_match_func( comp, match_completion, NULL, NULL );
+    completion_store = gtk_list_store_new( 1, G_TYPE_STRING );
+    completion_entry = entry;
+    exec_names = g_ptr_array_new_with_free_func( g_free );
+    exec_names_sorted = TRUE;
+
+    /* the index is resident, so only the first opening has to wait for PATH to be scanned; while that
+       happens, names are added as the scanner finds them, and the listener is first sent every name
+       already known */
+    exec_index_get();
+    exec_notify_id = exec_index_add_notify( on_exec_index_changed, NULL );
+
+    g_signal_connect( entry, "changed", G_CALLBACK(on_completion_entry_changed), NULL );
+    gtk_entry_completion_set_model( comp, (GtkTreeModel*)completion_store );
+    g_object_unref( completion_store );
+    gtk_entry_completion_set_text_column( comp, 0 );
+    gtk_entry_set_completion( entry, comp );
+
+    /* trigger entry completion */
+    refill_completion_store();
+    gtk_entry_completion_complete(comp);
+    g_object_unref( comp );
 }
 
 #ifndef DISABLE_MENU
+static void free_apps(void)
+{
+    /* the shown app may be freed with the list */
+    icon_shown = FALSE;
+    free_app_index();
+    g_slist_foreach(app_list, (GFunc)menu_cache_item_unref, NULL);
+    g_slist_free(app_list);
+    app_list = NULL;
+}
+
+/* this never waits for menu-cache: if the cache is not loaded yet, the reload notification will bring the apps */
+static void load_apps(void)
+{
+    app_list = menu_cache_list_all_apps(menu_cache);
+    if( app_list )
+        build_app_index();
+}
+
 static void reload_apps(MenuCache* cache, gpointer)
 {
     g_debug("reload apps!");
-    if(app_list)
+    free_apps();
+    if( win ) /* otherwise they are loaded next time the dialog opens */
+        load_apps();
+}
+
+/* The menu plugin passes in its own menu cache, so the process holds a single copy of the menu */
+void gtk_run_set_menu_cache( MenuCache* cache )
+{
+    if( cache == menu_cache )
+        return;
+
+    if( menu_cache )
+    {
+        free_apps();
+        menu_cache_remove_reload_notify(menu_cache, reload_notify_id);
+        reload_notify_id = NULL;
+        menu_cache_unref(menu_cache);
+    }
+
+    menu_cache = cache;
+    if( menu_cache )
     {
-        g_slist_foreach(app_list, (GFunc)menu_cache_item_unref, NULL);
-        g_slist_free(app_list);
+        menu_cache_ref(menu_cache);
+        reload_notify_id = menu_cache_add_reload_notify(menu_cache, reload_apps, NULL);
+        if( win )
+            load_apps();
     }
-    app_list = menu_cache_list_all_apps(cache);
 }
+
+/* Called when a plugin drops its menu cache; another plugin's cache stays in use */
+void gtk_run_unset_menu_cache( MenuCache* cache )
+{
+    if( cache == menu_cache )
+        gtk_run_set_menu_cache( NULL );
+}
+
+static void on_icon_theme_changed( GtkIconTheme* theme, gpointer user_data );
 #endif
 
-static void on_response( GtkDialog* dlg, gint response, gpointer user_data )
+static void close_dialog( GtkDialog* dlg );
+
+/* Called with the last plugin, whether or not it had a menu cache: the dialog goes, along with the handler on the
+   icon theme, which would otherwise be called after the module is unloaded */
+void gtk_run_cleanup( void )
 {
-    GtkEntry* entry = (GtkEntry*)user_data;
-    if( G_LIKELY(response == GTK_RESPONSE_OK) )
+    if( win )
+        close_dialog( (GtkDialog*)win );
+#ifndef DISABLE_MENU
+    if( icon_theme_handler )
     {
-        if (!fm_launch_command_simple(GTK_WINDOW(dlg), NULL, 0, gtk_entry_get_text(entry), NULL))
-        {
-            g_signal_stop_emission_by_name( dlg, "response" );
-            return;
-        }
+        g_signal_handler_disconnect( gtk_icon_theme_get_default(), icon_theme_handler );
+        icon_theme_handler = 0;
     }
+    on_icon_theme_changed( NULL, NULL );
+#endif
+
+    /* a launch still in progress finds no history, and is simply not recorded */
+    command_history_close( command_history );
+    command_history = NULL;
+}
 
-    /* cancel running thread if needed */
-    if( thread_data ) /* the thread is still running */
-        thread_data->cancel = TRUE; /* cancel the thread */
+static void close_dialog( GtkDialog* dlg )
+{
+    /* stop following the executable index */
+    exec_index_remove_notify( exec_notify_id );
+    exec_notify_id = NULL;
+    if( refill_idle )
+    {
+        g_source_remove( refill_idle );
+        refill_idle = 0;
+    }
+    g_ptr_array_unref( exec_names );
+    exec_names = NULL;
+    completion_store = NULL;
+    completion_entry = NULL;
 
     gtk_widget_destroy( (GtkWidget*)dlg );
     win = NULL;
+    ++win_gen;
 
 #ifndef DISABLE_MENU
-    /* free app list */
-    g_slist_foreach(app_list, (GFunc)menu_cache_item_unref, NULL);
-    g_slist_free(app_list);
-    app_list = NULL;
-
-    /* free menu cache */
-    menu_cache_remove_reload_notify(menu_cache, reload_notify_id);
-    reload_notify_id = NULL;
-    menu_cache_unref(menu_cache);
-    menu_cache = NULL;
+    /* the apps are kept for next time, but what was typed need not be */
+    if( resolve_idle )
+    {
+        g_source_remove(resolve_idle);
+        resolve_idle = 0;
+    }
+    if( resolved )
+        g_hash_table_remove_all(resolved);
+    icon_shown = FALSE;
 #endif
 }
 
+typedef struct _RunLaunch
+{
+    guint gen;
+    char* command;
+}RunLaunch;
+
+/* called once the command has started or failed - the dialog only closes if it started */
+static void on_launched( gboolean launched, gpointer user_data )
+{
+    RunLaunch* run = (RunLaunch*)user_data;
+
+    /* the dialog may have been closed from the window manager meanwhile, and another opened in its place */
+    if( win && run->gen == win_gen )
+    {
+        if( launched )
+        {
+            command_history_add( command_history, run->command );
+            close_dialog( (GtkDialog*)win );
+        }
+        else
+            gtk_widget_set_sensitive( win, TRUE );
+    }
+    g_free( run->command );
+    g_slice_free( RunLaunch, run );
+}
+
+static void on_response( GtkDialog* dlg, gint response, gpointer user_data )
+{
+    GtkEntry* entry = (GtkEntry*)user_data;
+    RunLaunch* run;
+
+    if( G_LIKELY(response == GTK_RESPONSE_OK) )
+    {
+        /* the command is started in a worker thread, so a slow exec cannot hold up the panel */
+        run = g_slice_new( RunLaunch );
+        run->gen = win_gen;
+        run->command = g_strdup( gtk_entry_get_text(entry) );
+        gtk_widget_set_sensitive( (GtkWidget*)dlg, FALSE );
+        app_launch_command( GTK_WINDOW(dlg), run->command, on_launched, run );
+        g_signal_stop_emission_by_name( dlg, "response" );
+        return;
+    }
+    close_dialog( dlg );
+}
+
 #ifndef DISABLE_MENU
-static void on_entry_changed( GtkEntry* entry, GtkImage* img )
+/* the cached icons came from the old theme */
+static void on_icon_theme_changed( GtkIconTheme* theme, gpointer user_data )
 {
-    const char* str = gtk_entry_get_text(entry);
-    MenuCacheApp* app = NULL;
-    if( str && *str )
-        app = match_app_by_exec(str);
+    int i;
 
-    if( app )
+    for( i = 0; i < ICON_CACHE_SIZE && icon_cache[i].name; ++i )
+    {
+        g_free( icon_cache[i].name );
+        g_object_unref( icon_cache[i].pix );
+        icon_cache[i].name = NULL;
+        icon_cache[i].pix = NULL;
+    }
+}
+
+static GdkPixbuf* lookup_app_icon( const char* name )
+{
+    IconCacheEntry ent;
+    FmIcon* fm_icon;
+    int i, w, h;
+
+    for( i = 0; i < ICON_CACHE_SIZE && icon_cache[i].name; ++i )
+        if( ! strcmp( icon_cache[i].name, name ) )
+            break;
+
+    if( i < ICON_CACHE_SIZE && icon_cache[i].name )
+        ent = icon_cache[i];
+    else
     {
-        int w, h;
-        const char *name = menu_cache_item_get_icon(MENU_CACHE_ITEM(app));
-        FmIcon * fm_icon;
-        GdkPixbuf* pix;
+        if( ! icon_theme_handler )
+            icon_theme_handler = g_signal_connect( gtk_icon_theme_get_default(), "changed", G_CALLBACK(on_icon_theme_changed), NULL );
 
         gtk_icon_size_lookup(GTK_ICON_SIZE_DIALOG, &w, &h);
-        fm_icon = fm_icon_from_name(name ? name : "application-x-executable");
-        pix = fm_pixbuf_from_icon_with_fallback(fm_icon, h, "application-x-executable");
+        fm_icon = fm_icon_from_name(name);
+        ent.pix = fm_pixbuf_from_icon_with_fallback(fm_icon, h, "application-x-executable");
         g_object_unref(fm_icon);
-        gtk_image_set_from_pixbuf(img, pix);
-        g_object_unref(pix);
+        if( ! ent.pix )
+            return NULL;
+        ent.name = g_strdup( name );
+
+        /* drop the least recently used icon if the cache is full */
+        if( i == ICON_CACHE_SIZE )
+        {
+            --i;
+            g_free( icon_cache[i].name );
+            g_object_unref( icon_cache[i].pix );
+        }
+    }
+
+    /* move to the front */
+    memmove( icon_cache + 1, icon_cache, i * sizeof(IconCacheEntry) );
+    icon_cache[0] = ent;
+    return ent.pix;
+}
+
+static void set_app_icon( GtkImage* img, MenuCacheApp* app )
+{
+    GdkPixbuf* pix = NULL;
+    const char* name;
+
+    /* nothing to do while the same app stays matched */
+    if( icon_shown && app == shown_app )
+        return;
+    icon_shown = TRUE;
+    shown_app = app;
+
+    if( app )
+    {
+        name = menu_cache_item_get_icon(MENU_CACHE_ITEM(app));
+        pix = lookup_app_icon( name ? name : "application-x-executable" );
     }
+
+    if( pix )
+        gtk_image_set_from_pixbuf(img, pix);
     else
     {
 #if GTK_CHECK_VERSION(3, 0, 0)
@@ -349,6 +645,37 @@ static void on_entry_changed( GtkEntry* entry, GtkImage* img )
 #endif
     }
 }
+
+static gboolean resolve_app_idle( gpointer user_data )
+{
+    const char* str = gtk_entry_get_text(resolve_entry);
+    MenuCacheApp* app = match_app_by_exec(str);
+
+    g_hash_table_insert(resolved, g_strdup(str), app);
+    set_app_icon((GtkImage*)user_data, app);
+    resolve_idle = 0;
+    return FALSE;
+}
+
+static void on_entry_changed( GtkEntry* entry, GtkImage* img )
+{
+    const char* str = gtk_entry_get_text(entry);
+    MenuCacheApp* app = NULL;
+
+    if( resolve_idle )
+    {
+        g_source_remove(resolve_idle);
+        resolve_idle = 0;
+    }
+
+    /* anything which needs the file system is looked up once the keystroke has been handled */
+    if( str && *str && app_by_exec && ! find_app_by_exec(str, &app) )
+    {
+        resolve_entry = entry;
+        resolve_idle = g_idle_add(resolve_app_idle, img);
+    }
+    set_app_icon(img, app);
+}
 #endif
 
 static void activate_window(GtkWindow* toplevel_window)
@@ -385,10 +712,14 @@ static void activate_window(GtkWindow* toplevel_window)
 
 void gtk_run()
 {
+    TRACE_BEGIN( start );
     GtkWidget *entry, *hbox, *img, *dlg_vbox;
 
     if(!win)
     {
+        /* app icons are looked up through libfm */
+        app_launch_fm_init();
+
         win = gtk_dialog_new_with_buttons( _("Run"),
                                            NULL,
                                            0,
@@ -429,34 +760,22 @@ void gtk_run()
         gtk_window_set_default_size( (GtkWindow*)win, 360, -1 );
         gtk_widget_show_all( win );
 
+        if( ! command_history )
+            command_history = command_history_open( "commands" );
         setup_auto_complete( (GtkEntry*)entry );
         gtk_widget_show(win);
 
 #ifndef DISABLE_MENU
         g_signal_connect(entry ,"changed", G_CALLBACK(on_entry_changed), img);
 
-        /* get all apps */
-#ifndef MENU_CACHE_CHECK_VERSION
-#define MENU_CACHE_CHECK_VERSION(a,b,c) 0
-#endif
-#if MENU_CACHE_CHECK_VERSION(0, 6, 1)
-        menu_cache = menu_cache_lookup_sync(g_getenv("XDG_MENU_PREFIX") ? "applications.menu" : "lxde-applications.menu" );
-        if( menu_cache )
-        {
-#else
-        /* SF bug #689: menu_cache_lookup_sync() was fail-prone before 0.6.1 */
-        menu_cache = menu_cache_lookup(g_getenv("XDG_MENU_PREFIX") ? "applications.menu" : "lxde-applications.menu" );
-        if( menu_cache )
-        {
-            menu_cache_reload(menu_cache);
-#endif
-            app_list = menu_cache_list_all_apps(menu_cache);
-            reload_notify_id = menu_cache_add_reload_notify(menu_cache, reload_apps, NULL);
-        }
+        /* the apps come from the menu plugin's cache, which is normally loaded long before this */
+        if( menu_cache && ! app_list )
+            load_apps();
 #endif
     }
 
     activate_window(GTK_WINDOW(win));
+    TRACE_END( start, "gtk_run" );
 }
 
 
@@ -0,0 +1,324 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "history.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+#define HISTORY_MAGIC       0x534d4c48
+#define HISTORY_VERSION     1
+#define HISTORY_SLOTS       512     /* Must be a power of two */
+#define HISTORY_PROBES      8       /* Longest run of slots searched for an id */
+#define HISTORY_HALF_LIFE   (7 * 24 * 60 * 60)
+
+#define HISTORY_SIZE (sizeof (HistoryHeader) + HISTORY_SLOTS * sizeof (HistoryRecord))
+
+#define COMMAND_MAGIC       0x534d4343
+#define COMMAND_VERSION     1
+#define COMMAND_ENTRIES     64
+
+#define COMMAND_SIZE (sizeof (HistoryHeader) + COMMAND_ENTRIES * sizeof (CommandEntry))
+
+typedef struct
+{
+    const char *command;
+    gfloat score;
+} CommandMatch;
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+static guint32 history_hash (const char *id)
+{
+    char key[HISTORY_ID_LEN];
+    guint32 hash;
+
+    /* hash what is stored, so that truncated ids still find themselves */
+    g_strlcpy (key, id, HISTORY_ID_LEN);
+    hash = g_str_hash (key);
+    return hash ? hash : 1;
+}
+
+/* Scores halve every HISTORY_HALF_LIFE seconds without a launch */
+
+static gfloat history_decay (const HistoryRecord *rec, gint64 now)
+{
+    if (now <= rec->stamp) return rec->score;
+    return rec->score * exp2 (-(double) (now - rec->stamp) / HISTORY_HALF_LIFE);
+}
+
+static HistoryRecord *history_find (LaunchHistory *hist, const char *id, guint32 hash)
+{
+    HistoryRecord *rec;
+    guint32 i, mask = hist->header->nslots - 1;
+
+    for (i = 0; i < HISTORY_PROBES; i++)
+    {
+        rec = &hist->slots[(hash + i) & mask];
+        if (!rec->hash) return NULL;
+        if (rec->hash == hash && !strncmp (rec->id, id, HISTORY_ID_LEN - 1)) return rec;
+    }
+    return NULL;
+}
+
+/* Map the named file from the user cache directory, creating it if needed; a file written by an incompatible
+ * version, or a new one, is cleared and given a fresh header */
+
+static HistoryHeader *history_map (const char *name, gsize size, guint32 magic, guint32 version, guint32 nslots)
+{
+    HistoryHeader *header;
+    struct stat st;
+    char *dir, *path;
+    gpointer map;
+    int fd;
+
+    dir = g_build_filename (g_get_user_cache_dir (), "smenu", NULL);
+    g_mkdir_with_parents (dir, 0700);
+    path = g_build_filename (dir, name, NULL);
+    fd = open (path, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    g_free (path);
+    g_free (dir);
+    if (fd < 0) return NULL;
+
+    if (fstat (fd, &st) < 0 || (st.st_size != (off_t) size && ftruncate (fd, size) < 0))
+    {
+        close (fd);
+        return NULL;
+    }
+
+    map = mmap (NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close (fd);
+    if (map == MAP_FAILED) return NULL;
+
+    header = (HistoryHeader *) map;
+    if (header->magic != magic || header->version != version || header->nslots != nslots)
+    {
+        memset (map, 0, size);
+        header->magic = magic;
+        header->version = version;
+        header->nslots = nslots;
+    }
+    return header;
+}
+
+/* Open the app launch history, shared by every menu in the process */
+
+LaunchHistory *history_open (const char *name)
+{
+    LaunchHistory *hist;
+    HistoryHeader *header;
+
+    header = history_map (name, HISTORY_SIZE, HISTORY_MAGIC, HISTORY_VERSION, HISTORY_SLOTS);
+    if (!header) return NULL;
+
+    hist = g_new0 (LaunchHistory, 1);
+    hist->header = header;
+    hist->slots = (HistoryRecord *) (header + 1);
+    hist->size = HISTORY_SIZE;
+    return hist;
+}
+
+void history_close (LaunchHistory *hist)
+{
+    if (!hist) return;
+    munmap (hist->header, hist->size);
+    g_free (hist);
+}
+
+/* Called on each launch - updates the record in place in the mapped file */
+
+void history_record (LaunchHistory *hist, const char *id)
+{
+    HistoryRecord *rec, *victim = NULL;
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+    guint32 i, hash, mask;
+
+    if (!hist || !id) return;
+
+    hash = history_hash (id);
+    rec = history_find (hist, id, hash);
+    if (!rec)
+    {
+        /* take the first free slot in the probe run, otherwise the one with the lowest score */
+        mask = hist->header->nslots - 1;
+        for (i = 0; i < HISTORY_PROBES; i++)
+        {
+            rec = &hist->slots[(hash + i) & mask];
+            if (!rec->hash) break;
+            if (!victim || history_decay (rec, now) < history_decay (victim, now)) victim = rec;
+        }
+        if (i == HISTORY_PROBES) rec = victim;
+
+        memset (rec, 0, sizeof (HistoryRecord));
+        g_strlcpy (rec->id, id, HISTORY_ID_LEN);
+        rec->hash = hash;
+    }
+
+    rec->score = history_decay (rec, now) + 1.0;
+    rec->stamp = now;
+}
+
+/* Current score for an id, 0 if it has never been launched */
+
+gfloat history_score (LaunchHistory *hist, const char *id, gint64 now)
+{
+    HistoryRecord *rec;
+
+    if (!hist || !id) return 0.0;
+    rec = history_find (hist, id, history_hash (id));
+    return rec ? history_decay (rec, now) : 0.0;
+}
+
+/* Run dialog command history - a table of up to COMMAND_ENTRIES distinct command lines */
+
+/* The same decay as launches, so a command used often long ago falls behind one used recently */
+
+static gfloat command_score (const CommandEntry *ent, gint64 now)
+{
+    HistoryRecord rec;
+
+    rec.score = ent->count;
+    rec.stamp = ent->stamp;
+    return history_decay (&rec, now);
+}
+
+/* The commands are used as strings in place, so an entry only counts if its command ends inside it - the file may
+ * have been damaged, or be being written by another process */
+
+static gboolean command_is_set (const CommandEntry *ent)
+{
+    return ent->count && memchr (ent->command, 0, COMMAND_LEN);
+}
+
+CommandHistory *command_history_open (const char *name)
+{
+    CommandHistory *hist;
+    HistoryHeader *header;
+    guint32 i;
+
+    header = history_map (name, COMMAND_SIZE, COMMAND_MAGIC, COMMAND_VERSION, COMMAND_ENTRIES);
+    if (!header) return NULL;
+
+    hist = g_new0 (CommandHistory, 1);
+    hist->header = header;
+    hist->entries = (CommandEntry *) (header + 1);
+    hist->size = COMMAND_SIZE;
+
+    for (i = 0; i < COMMAND_ENTRIES; i++)
+        if (!command_is_set (&hist->entries[i])) memset (&hist->entries[i], 0, sizeof (CommandEntry));
+    return hist;
+}
+
+void command_history_close (CommandHistory *hist)
+{
+    if (!hist) return;
+    munmap (hist->header, hist->size);
+    g_free (hist);
+}
+
+/* A command already in the table has its count bumped in place; otherwise it takes a free entry, or once the table
+ * is full, the one with the lowest score, so that commands used often are kept however many one-off commands follow */
+
+void command_history_add (CommandHistory *hist, const char *command)
+{
+    CommandEntry *ent, *victim = NULL;
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+    guint32 i;
+
+    if (!hist || !command || !*command || strlen (command) >= COMMAND_LEN) return;
+
+    for (i = 0; i < COMMAND_ENTRIES; i++)
+    {
+        ent = &hist->entries[i];
+        if (!command_is_set (ent))
+        {
+            if (!victim || command_is_set (victim)) victim = ent;
+            continue;
+        }
+        if (!strcmp (ent->command, command)) break;
+        if (!victim || (command_is_set (victim) && command_score (ent, now) < command_score (victim, now))) victim = ent;
+    }
+    if (i == COMMAND_ENTRIES)
+    {
+        ent = victim;
+        memset (ent, 0, sizeof (CommandEntry));
+        strcpy (ent->command, command);
+    }
+
+    ent->count++;
+    ent->stamp = now;
+}
+
+static gint compare_matches (gconstpointer a, gconstpointer b)
+{
+    const CommandMatch *ma = (const CommandMatch *) a, *mb = (const CommandMatch *) b;
+    return ma->score < mb->score ? 1 : ma->score > mb->score ? -1 : 0;
+}
+
+/* Commands starting with prefix, most used first - the strings point into the mapping */
+
+GPtrArray *command_history_match (CommandHistory *hist, const char *prefix)
+{
+    CommandMatch matches[COMMAND_ENTRIES];
+    CommandEntry *ent;
+    GPtrArray *res = g_ptr_array_new ();
+    gint64 now = g_get_real_time () / G_USEC_PER_SEC;
+    gsize len = strlen (prefix);
+    guint32 i, n = 0;
+
+    if (!hist) return res;
+
+    for (i = 0; i < COMMAND_ENTRIES; i++)
+    {
+        ent = &hist->entries[i];
+        if (!command_is_set (ent) || strncmp (ent->command, prefix, len)) continue;
+
+        matches[n].command = ent->command;
+        matches[n].score = command_score (ent, now);
+        n++;
+    }
+
+    qsort (matches, n, sizeof (CommandMatch), compare_matches);
+    for (i = 0; i < n; i++) g_ptr_array_add (res, (gpointer) matches[i].command);
+    return res;
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
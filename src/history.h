@@ -0,0 +1,95 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+#define HISTORY_ID_LEN 48
+
+/* One launched app - fixed size so the table can be used in place in the mapped file */
+typedef struct
+{
+    guint32 hash;                   /* Hash of id, 0 for an empty slot */
+    gfloat score;                   /* Frecency score as at stamp */
+    gint64 stamp;                   /* Time of last launch, seconds since the epoch */
+    char id[HISTORY_ID_LEN];        /* Desktop id, possibly truncated */
+} HistoryRecord;
+
+typedef struct
+{
+    guint32 magic;
+    guint32 version;
+    guint32 nslots;
+    guint32 reserved;
+} HistoryHeader;
+
+typedef struct
+{
+    HistoryHeader *header;          /* Start of the mapping */
+    HistoryRecord *slots;           /* Open-addressed hash table following the header */
+    gsize size;                     /* Size of the mapping */
+} LaunchHistory;
+
+#define COMMAND_LEN 240
+
+/* One command line typed into the Run dialog - 256 bytes, so the table is a whole number of pages */
+typedef struct
+{
+    guint32 count;                  /* Number of times run, 0 for an empty entry */
+    guint32 reserved;
+    gint64 stamp;                   /* Time of last run, seconds since the epoch */
+    char command[COMMAND_LEN];      /* Command line; longer ones are not stored */
+} CommandEntry;
+
+typedef struct
+{
+    HistoryHeader *header;          /* Start of the mapping; nslots is the number of entries */
+    CommandEntry *entries;          /* Table following the header */
+    gsize size;                     /* Size of the mapping */
+} CommandHistory;
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+extern LaunchHistory *history_open (const char *name);
+extern void history_close (LaunchHistory *hist);
+extern void history_record (LaunchHistory *hist, const char *id);
+extern gfloat history_score (LaunchHistory *hist, const char *id, gint64 now);
+extern CommandHistory *command_history_open (const char *name);
+extern void command_history_close (CommandHistory *hist);
+extern void command_history_add (CommandHistory *hist, const char *command);
+extern GPtrArray *command_history_match (CommandHistory *hist, const char *prefix);
+
+#endif
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,334 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <glib.h>
+
+#if defined (__x86_64__)
+#include <immintrin.h>
+#define SMATCH_HAVE_X86
+#elif defined (__aarch64__) || defined (__ARM_NEON)
+#include <arm_neon.h>
+#define SMATCH_HAVE_NEON
+#endif
+
+#include "smatch.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+typedef unsigned (*ScanFunc) (const SMatchBuf *b, const char *query, size_t qlen, unsigned first, unsigned last, unsigned *rows);
+
+/* Common setup for the vector kernels - the candidate search covers every byte from the start of the first row to the end of the last */
+#define SCAN_SETUP \
+    const char *buf = b->buf; \
+    size_t start = b->offsets[first]; \
+    size_t end = row_end (b, last - 1); \
+    size_t p = start, skip = 0; \
+    unsigned r = first, n = 0;
+
+/* Walk the candidate bits in a block mask, verifying each one; stride is the number of mask bits per byte */
+#define SCAN_HITS(mask, base, stride) \
+    while (mask) \
+    { \
+        size_t pos = (base) + __builtin_ctzll (mask) / (stride); \
+        mask &= mask - 1; \
+        if (pos >= end) break; \
+        if (pos < skip) continue; \
+        while (row_end (b, r) <= pos) r++; \
+        if (verify (buf + pos, query, qlen)) \
+        { \
+            rows[n++] = r; \
+            skip = row_end (b, r); \
+        } \
+    }
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+static ScanFunc scan_func;
+static const char *scan_name;
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+/* Only ASCII is folded, which matches strcasestr in a UTF-8 locale */
+
+static inline char fold_char (char c)
+{
+    return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+}
+
+static inline size_t row_end (const SMatchBuf *b, unsigned row)
+{
+    return row + 1 < b->count ? b->offsets[row + 1] : b->len;
+}
+
+/* Full compare of a candidate - cannot run into the next name, as the query never contains the terminating NUL */
+
+static inline int verify (const char *str, const char *query, size_t qlen)
+{
+    size_t i;
+
+    for (i = 0; i < qlen; i++)
+        if (str[i] != query[i]) return 0;
+    return 1;
+}
+
+/* Reference kernel - also used where no vector unit is available */
+
+static unsigned scan_scalar (const SMatchBuf *b, const char *query, G_GNUC_UNUSED size_t qlen, unsigned first, unsigned last, unsigned *rows)
+{
+    unsigned r, n = 0;
+
+    for (r = first; r < last; r++)
+        if (strstr (b->buf + b->offsets[r], query)) rows[n++] = r;
+    return n;
+}
+
+#ifdef SMATCH_HAVE_X86
+static unsigned scan_sse2 (const SMatchBuf *b, const char *query, size_t qlen, unsigned first, unsigned last, unsigned *rows)
+{
+    SCAN_SETUP
+    __m128i v0 = _mm_set1_epi8 (query[0]);
+    __m128i v1 = _mm_set1_epi8 (query[1]);
+    __m128i eq;
+    uint64_t mask;
+
+    while (p < end)
+    {
+        if (p < skip)
+        {
+            p = skip;
+            continue;
+        }
+
+        /* first character, then the bigram prefilter */
+        eq = _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (buf + p)), v0);
+        if (qlen > 1) eq = _mm_and_si128 (eq, _mm_cmpeq_epi8 (_mm_loadu_si128 ((const __m128i *) (buf + p + 1)), v1));
+        mask = (unsigned) _mm_movemask_epi8 (eq);
+        SCAN_HITS (mask, p, 1);
+        p += 16;
+    }
+    return n;
+}
+
+__attribute__ ((target ("avx2")))
+static unsigned scan_avx2 (const SMatchBuf *b, const char *query, size_t qlen, unsigned first, unsigned last, unsigned *rows)
+{
+    SCAN_SETUP
+    __m256i v0 = _mm256_set1_epi8 (query[0]);
+    __m256i v1 = _mm256_set1_epi8 (query[1]);
+    __m256i eq;
+    uint64_t mask;
+
+    while (p < end)
+    {
+        if (p < skip)
+        {
+            p = skip;
+            continue;
+        }
+
+        eq = _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (buf + p)), v0);
+        if (qlen > 1) eq = _mm256_and_si256 (eq, _mm256_cmpeq_epi8 (_mm256_loadu_si256 ((const __m256i *) (buf + p + 1)), v1));
+        mask = (unsigned) _mm256_movemask_epi8 (eq);
+        SCAN_HITS (mask, p, 1);
+        p += 32;
+    }
+    return n;
+}
+#endif
+
+#ifdef SMATCH_HAVE_NEON
+static unsigned scan_neon (const SMatchBuf *b, const char *query, size_t qlen, unsigned first, unsigned last, unsigned *rows)
+{
+    SCAN_SETUP
+    uint8x16_t v0 = vdupq_n_u8 ((uint8_t) query[0]);
+    uint8x16_t v1 = vdupq_n_u8 ((uint8_t) query[1]);
+    uint8x16_t eq;
+    uint64_t mask;
+
+    while (p < end)
+    {
+        if (p < skip)
+        {
+            p = skip;
+            continue;
+        }
+
+        eq = vceqq_u8 (vld1q_u8 ((const uint8_t *) (buf + p)), v0);
+        if (qlen > 1) eq = vandq_u8 (eq, vceqq_u8 (vld1q_u8 ((const uint8_t *) (buf + p + 1)), v1));
+
+        /* NEON has no movemask - narrow to four bits per byte and keep one of them */
+        mask = vget_lane_u64 (vreinterpret_u64_u8 (vshrn_n_u16 (vreinterpretq_u16_u8 (eq), 4)), 0);
+        mask &= 0x8888888888888888ULL;
+        SCAN_HITS (mask, p, 4);
+        p += 16;
+    }
+    return n;
+}
+#endif
+
+/* Buffer management */
+
+void smatch_init (SMatchBuf *b)
+{
+    memset (b, 0, sizeof (SMatchBuf));
+}
+
+void smatch_free (SMatchBuf *b)
+{
+    /* a mapped buffer has no allocation of its own */
+    if (b->size) free (b->buf);
+    if (b->alloc) free (b->offsets);
+    smatch_init (b);
+}
+
+/* Use a buffer which was laid out by smatch_add and saved, with SMATCH_PAD zeroed bytes after it, without copying it.
+ * The buffer and offsets must outlive b, and nothing may be added. */
+
+void smatch_map (SMatchBuf *b, const char *buf, size_t len, const unsigned *offsets, unsigned count)
+{
+    smatch_init (b);
+    b->buf = (char *) buf;
+    b->len = len;
+    b->offsets = (unsigned *) offsets;
+    b->count = count;
+}
+
+void smatch_add (SMatchBuf *b, const char *name)
+{
+    size_t len = strlen (name) + 1, size;
+
+    if (b->len + len + SMATCH_PAD > b->size)
+    {
+        size = b->size ? b->size : 4096;
+        while (b->len + len + SMATCH_PAD > size) size *= 2;
+        b->buf = realloc (b->buf, size);
+        memset (b->buf + b->size, 0, size - b->size);
+        b->size = size;
+    }
+
+    if (b->count == b->alloc)
+    {
+        b->alloc = b->alloc ? b->alloc * 2 : 256;
+        b->offsets = realloc (b->offsets, b->alloc * sizeof (unsigned));
+    }
+
+    b->offsets[b->count++] = b->len;
+    smatch_fold (b->buf + b->len, name, len);
+    b->len += len;
+}
+
+void smatch_fold (char *dest, const char *src, size_t size)
+{
+    if (!size) return;
+    while (--size && *src) *dest++ = fold_char (*src++);
+    *dest = 0;
+}
+
+/* Kernel selection */
+
+int smatch_set_kernel (SMatchKernel kernel)
+{
+    switch (kernel)
+    {
+        case SMATCH_AUTO :
+#if defined (SMATCH_HAVE_X86)
+            __builtin_cpu_init ();
+            return smatch_set_kernel (__builtin_cpu_supports ("avx2") ? SMATCH_AVX2 : SMATCH_SSE2);
+#elif defined (SMATCH_HAVE_NEON)
+            return smatch_set_kernel (SMATCH_NEON);
+#else
+            return smatch_set_kernel (SMATCH_SCALAR);
+#endif
+
+        case SMATCH_SCALAR :
+            scan_func = scan_scalar;
+            scan_name = "scalar";
+            return 1;
+
+#ifdef SMATCH_HAVE_X86
+        case SMATCH_SSE2 :
+            scan_func = scan_sse2;
+            scan_name = "sse2";
+            return 1;
+
+        case SMATCH_AVX2 :
+            __builtin_cpu_init ();
+            if (!__builtin_cpu_supports ("avx2")) return 0;
+            scan_func = scan_avx2;
+            scan_name = "avx2";
+            return 1;
+#endif
+
+#ifdef SMATCH_HAVE_NEON
+        case SMATCH_NEON :
+            scan_func = scan_neon;
+            scan_name = "neon";
+            return 1;
+#endif
+
+        default :
+            return 0;
+    }
+}
+
+const char *smatch_kernel_name (void)
+{
+    if (!scan_func) smatch_set_kernel (SMATCH_AUTO);
+    return scan_name;
+}
+
+/* Find the rows in [first, last) which contain the already-folded query; returns the number of row numbers written to rows */
+
+unsigned smatch_scan (const SMatchBuf *b, const char *query, unsigned first, unsigned last, unsigned *rows)
+{
+    size_t qlen = strlen (query);
+    unsigned r, n = 0;
+
+    if (last > b->count) last = b->count;
+    if (first >= last) return 0;
+
+    if (!qlen)
+    {
+        for (r = first; r < last; r++) rows[n++] = r;
+        return n;
+    }
+
+    if (!scan_func) smatch_set_kernel (SMATCH_AUTO);
+    return scan_func (b, query, qlen, first, last, rows);
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,76 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#ifndef SMATCH_H
+#define SMATCH_H
+
+#include <stddef.h>
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+/* Zeroed bytes kept after the last name, so vector loads can run past the end */
+#define SMATCH_PAD 64
+
+/* Packed buffer of case-folded names, each terminated by a NUL */
+typedef struct
+{
+    char *buf;
+    size_t len;                     /* Bytes used, excluding padding */
+    size_t size;                    /* Bytes allocated, 0 if mapped */
+    unsigned *offsets;              /* Start of each name in buf */
+    unsigned count;
+    unsigned alloc;                 /* Offsets allocated, 0 if mapped */
+} SMatchBuf;
+
+typedef enum
+{
+    SMATCH_AUTO,
+    SMATCH_SCALAR,
+    SMATCH_SSE2,
+    SMATCH_AVX2,
+    SMATCH_NEON
+} SMatchKernel;
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+extern void smatch_init (SMatchBuf *b);
+extern void smatch_free (SMatchBuf *b);
+extern void smatch_add (SMatchBuf *b, const char *name);
+extern void smatch_map (SMatchBuf *b, const char *buf, size_t len, const unsigned *offsets, unsigned count);
+extern void smatch_fold (char *dest, const char *src, size_t size);
+extern unsigned smatch_scan (const SMatchBuf *b, const char *query, unsigned first, unsigned last, unsigned *rows);
+extern int smatch_set_kernel (SMatchKernel kernel);
+extern const char *smatch_kernel_name (void);
+
+#endif
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
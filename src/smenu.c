@@ -41,6 +41,11 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 ============================================================================*/
 
 #include <locale.h>
+#include <stdio.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 #include <glib/gi18n.h>
 #include <menu-cache.h>
 #include <libfm/fm-gtk.h>
@@ -51,6 +56,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include "lxutils.h"
 #endif
 
+#include "smatch.h"
+#include "strpool.h"
+#include "history.h"
+#include "execindex.h"
+#include "applaunch.h"
+#include "warmup.h"
+#include "catalog.h"
+#include "trace.h"
 #include "smenu.h"
 
 #ifndef LXPLUG
@@ -63,6 +76,28 @@ extern void gtk_run (void);
 /* Typedefs and macros                                                        */
 /*----------------------------------------------------------------------------*/
 
+/* How many rows the search worker scans between checks for a newer query */
+#define SEARCH_CANCEL_STRIDE 128
+
+/* Most commands from PATH listed after the apps in search results */
+#define SEARCH_MAX_COMMANDS 8
+
+/* In low-memory mode, how long the menu stays built after it is closed, in seconds */
+#define RELEASE_DELAY 30
+
+/* Longest a rebuild of a released menu may take, in microseconds, before its icons are kept as well */
+#define REBUILD_BUDGET 100000
+
+typedef struct
+{
+    SearchState *state;
+    AppIndex *index;
+    char *query;
+    gint gen;
+    GArray *rows;                   /* Indices of matching apps, in display order */
+    GArray *scores;                 /* Frecency of each app, by index - read-only, shared with the plugin */
+} SearchJob;
+
 /*----------------------------------------------------------------------------*/
 /* Global data                                                                */
 /*----------------------------------------------------------------------------*/
@@ -71,38 +106,68 @@ static gboolean longpress;
 
 GQuark sys_menu_item_quark = 0;
 
+/* AppEntry for a menu item - the menu is always rebuilt along with the index, so this never outlives it */
+static GQuark app_entry_quark = 0;
+
+/* FmFileInfo for a menu item, once something has needed it */
+static GQuark file_info_quark = 0;
+
+/* Icon name for a menu item image, held by the index like the path */
+static GQuark icon_name_quark = 0;
+
+/* Generation of the icon store a mapped menu item image acquired its icon from */
+static GQuark icon_gen_quark = 0;
+
 /*----------------------------------------------------------------------------*/
 /* Prototypes                                                                 */
 /*----------------------------------------------------------------------------*/
 
-static gboolean _open_dir_in_file_manager (GAppLaunchContext *ctx, GList *folder_infos, gpointer, GError **err);
+static void clear_apps (MenuPlugin *m);
+static GArray *search_scores (MenuPlugin *m);
+static void clear_scores (MenuPlugin *m);
+static char *app_entry_path (AppEntry *entry);
+static void launch_entry (MenuPlugin *m, AppEntry *entry);
+static void add_command_results (MenuPlugin *m, GtkListStore *results, const char *query);
 static void destroy_search (MenuPlugin *m);
-static gboolean filter_apps (GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data);
+static void search_job_free (SearchJob *job);
+static gint compare_rows (gconstpointer a, gconstpointer b, gpointer user_data);
+static void search_apps (gpointer data, gpointer user_data);
+static gboolean apply_search_results (gpointer data);
 static void append_to_entry (GtkWidget *entry, char val);
 static void resize_search (MenuPlugin *m);
 static void handle_search_changed (GtkEditable *, gpointer user_data);
 static gboolean handle_list_keypress (GtkWidget *, GdkEventKey *event, gpointer user_data);
 static gboolean handle_search_keypress (GtkWidget *, GdkEventKey *event, gpointer user_data);
 static void handle_list_select (GtkTreeView *tv, GtkTreePath *path, GtkTreeViewColumn *, gpointer user_data);
+static void handle_search_cursor (GtkTreeView *tv, gpointer user_data);
+static void render_app_icon (GtkTreeViewColumn *col, GtkCellRenderer *cell, GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data);
+static void render_app_name (GtkTreeViewColumn *col, GtkCellRenderer *cell, GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data);
 static void search_destroyed (GtkWidget *, gpointer data);
 static void create_search (MenuPlugin *m);
-static void handle_menu_item_activate (GtkMenuItem *mi, MenuPlugin *);
+static void handle_menu_item_activate (GtkMenuItem *mi, MenuPlugin *m);
+static void handle_menu_item_select (GtkMenuItem *mi, MenuPlugin *m);
 static void handle_menu_item_properties (GtkMenuItem *, GtkWidget* mi);
 static void handle_restore_submenu (GtkMenuItem *mi, GtkWidget *submenu);
+static FmFileInfo *menu_item_file_info (GtkWidget *mi);
 static void handle_menu_item_data_get (FmDndSrc *ds, GtkWidget *mi);
 static void show_context_menu (GtkWidget* mi);
 static gboolean handle_menu_item_button_press (GtkWidget* mi, GdkEventButton* evt, MenuPlugin* m);
 static gboolean handle_key_presses (GtkWidget *, GdkEventKey *event, gpointer user_data);
-static GtkWidget *create_system_menu_item (MenuCacheItem *item, MenuPlugin *m);
-static int sys_menu_load_submenu (MenuPlugin* m, MenuCacheDir* dir, GtkWidget* menu, int pos);
+static GtkWidget *create_system_menu_item (const CatalogNode *node, MenuPlugin *m);
+static void sys_menu_load_nodes (MenuPlugin *m, const CatalogNode *nodes, guint n, GtkWidget *menu, int pos);
 static void sys_menu_insert_items (MenuPlugin *m, GtkMenu *menu, int position);
 static void reload_system_menu (MenuPlugin *m, GtkMenu *menu);
-static void handle_reload_menu (MenuCache *, gpointer user_data);
+static void handle_catalog_changed (gpointer user_data);
 static void read_system_menu (GtkMenu *menu, MenuPlugin *m);
 static void handle_run_command (GtkWidget *, gpointer data);
 static GtkWidget *read_menu_item (MenuPlugin *m, char *disp_name, char *icon, void (*cmd)(void));
 static void mlogout (void);
+static int item_icon_size (MenuPlugin *m);
 static gboolean create_menu (MenuPlugin *m);
+static glong resident_kb (void);
+static gboolean release_menu (gpointer user_data);
+static void handle_menu_closed (GtkWidget *menu, gpointer user_data);
+static void ensure_menu (MenuPlugin *m);
 static void menu_button_clicked (GtkWidget *, MenuPlugin *m);
 #ifdef LXPLUG
 static void handle_search_resize (GtkWidget *, GtkAllocation *, gpointer user_data);
@@ -118,29 +183,96 @@ static void handle_popped_up (GtkMenu *menu, gpointer, gpointer, gboolean, gbool
 /* Function definitions                                                       */
 /*----------------------------------------------------------------------------*/
 
-/* Open a specified path in a file manager */
+static void clear_apps (MenuPlugin *m)
+{
+    /* results point into the index, so must go first - any search still running holds its own reference to the old index */
+    if (m->swin) gtk_list_store_clear (GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (m->stv))));
+    app_index_unref (m->index);
+    m->index = app_index_ref (m->catalog->index);
+    g_ptr_array_set_size (m->commands, 0);
+    clear_scores (m);
+}
+
+/* The launch history is only written on the main thread, so the search worker ranks by a snapshot of it taken here.
+ * Every score decays at the same rate, so the ranking stays right until the next launch, and the snapshot is kept
+ * until then. */
+
+static GArray *search_scores (MenuPlugin *m)
+{
+    gint64 now;
+    gfloat score;
+    guint i;
+
+    if (!m->scores)
+    {
+        now = g_get_real_time () / G_USEC_PER_SEC;
+        m->scores = g_array_sized_new (FALSE, FALSE, sizeof (gfloat), m->index->apps->len);
+        for (i = 0; i < m->index->apps->len; i++)
+        {
+            score = history_score (m->history, ((AppEntry *) g_ptr_array_index (m->index->apps, i))->id, now);
+            g_array_append_val (m->scores, score);
+        }
+    }
+    return g_array_ref (m->scores);
+}
+
+static void clear_scores (MenuPlugin *m)
+{
+    if (m->scores) g_array_unref (m->scores);
+    m->scores = NULL;
+}
+
+/* The libfm view of a system menu item, made when first needed so that building the menu does not need libfm. The
+ * menu may have been built from a snapshot, so this is NULL until the menu cache has loaded. */
+
+static FmFileInfo *menu_item_file_info (GtkWidget *mi)
+{
+    FmFileInfo *fi = g_object_get_qdata (G_OBJECT (mi), file_info_quark);
+    const char *mpath;
+    MenuCacheItem *item;
+    FmPath *path;
+
+    if (fi) return fi;
+
+    mpath = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
+    item = catalog_find_item (mpath);
+    if (!item) return NULL;
+
+    app_launch_fm_init ();
+    path = fm_path_new_relative (fm_path_get_apps_menu (), mpath + 13);
+    fi = fm_file_info_new_from_menu_cache_item (path, item);
+    fm_path_unref (path);
+    menu_cache_item_unref (item);
+    g_object_set_qdata_full (G_OBJECT (mi), file_info_quark, fi, (GDestroyNotify) fm_file_info_unref);
+    return fi;
+}
+
+static char *app_entry_path (AppEntry *entry)
+{
+    return g_strconcat (entry->dir, entry->id, NULL);
+}
+
+/* Launches happen in a worker thread, so the menu or search popup can close straight away */
 
-static gboolean _open_dir_in_file_manager (GAppLaunchContext* ctx, GList* folder_infos,
-                                          gpointer, GError** err)
+static void launch_entry (MenuPlugin *m, AppEntry *entry)
 {
-    FmFileInfo *fi = folder_infos->data; /* only first is used */
-    GAppInfo *app = g_app_info_get_default_for_type("inode/directory", TRUE);
-    GFile *gf;
-    gboolean ret;
+    TRACE_BEGIN (start);
+    gchar *str;
 
-    if (app == NULL)
+    if (!entry->dir)
     {
-        g_set_error_literal(err, G_SHELL_ERROR, G_SHELL_ERROR_EMPTY_STRING,
-                            _("No file manager is configured."));
-        return FALSE;
+        app_launch_command (NULL, entry->name, NULL, NULL);
+        TRACE_END (start, "launch_command");
+        return;
     }
-    gf = fm_path_to_gfile(fm_file_info_get_path(fi));
-    folder_infos = g_list_prepend(NULL, gf);
-    ret = fm_app_info_launch(app, folder_infos, ctx, err);
-    g_list_free(folder_infos);
-    g_object_unref(gf);
-    g_object_unref(app);
-    return ret;
+
+    history_record (m->history, entry->id);
+    clear_scores (m);
+    /* without a desktop file, the app is looked up by its id */
+    str = app_entry_path (entry);
+    app_launch_file (entry->file, str);
+    g_free (str);
+    TRACE_END (start, "launch_entry");
 }
 
 /* Search box */
@@ -155,19 +287,138 @@ static void destroy_search (MenuPlugin *m)
     m->swin = NULL;
 }
 
-static gboolean filter_apps (GtkTreeModel *model, GtkTreeIter *iter, gpointer user_data)
+static void search_job_free (SearchJob *job)
 {
-    MenuPlugin *m = (MenuPlugin *) user_data;
-    gboolean res = FALSE;
-    char *str, *pstr = NULL;
-    GtkTreeIter prev = *iter;
-
-    gtk_tree_model_get (model, iter, 1, &str, -1);
-    if (gtk_tree_model_iter_previous (model, &prev)) gtk_tree_model_get (model, &prev, 1, &pstr, -1);
-    if ((!pstr || strcmp (str, pstr)) && strcasestr (str, gtk_entry_get_text (GTK_ENTRY (m->srch)))) res = TRUE;
-    if (pstr) g_free (pstr);
-    g_free (str);
-    return res;
+    if (g_atomic_int_dec_and_test (&job->state->ref)) g_free (job->state);
+    app_index_unref (job->index);
+    g_array_unref (job->rows);
+    g_array_unref (job->scores);
+    g_free (job->query);
+    g_free (job);
+}
+
+/* Most frequently and recently launched first, then alphabetical */
+
+static gint compare_rows (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+    SearchJob *job = (SearchJob *) user_data;
+    guint rowa = *(const guint *) a, rowb = *(const guint *) b;
+    AppEntry *enta = g_ptr_array_index (job->index->apps, rowa);
+    AppEntry *entb = g_ptr_array_index (job->index->apps, rowb);
+
+    gfloat scorea = g_array_index (job->scores, gfloat, rowa), scoreb = g_array_index (job->scores, gfloat, rowb);
+
+    if (scorea > scoreb) return -1;
+    if (scorea < scoreb) return 1;
+    return g_utf8_collate (enta->name, entb->name);
+}
+
+/* Runs in the search thread pool - matches the query against the index, giving up as soon as a newer query is submitted */
+
+static void search_apps (gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    TRACE_BEGIN (start);
+    SearchJob *job = (SearchJob *) data;
+    GPtrArray *apps = job->index->apps;
+    GHashTable *seen;
+    AppEntry *entry;
+    char *query;
+    guint i, row, len, nrows;
+
+    /* the kernel matches against pre-folded names, so fold the query the same way */
+    len = strlen (job->query) + 1;
+    query = g_malloc (len);
+    smatch_fold (query, job->query, len);
+
+    for (i = 0; i < apps->len; i += SEARCH_CANCEL_STRIDE)
+    {
+        if (g_atomic_int_get (&job->state->gen) != job->gen)
+        {
+            g_free (query);
+            search_job_free (job);
+            TRACE_END (start, "search_apps_cancelled");
+            return;
+        }
+        len = job->rows->len;
+        g_array_set_size (job->rows, len + SEARCH_CANCEL_STRIDE);
+        nrows = smatch_scan (&job->index->folded, query, i, i + SEARCH_CANCEL_STRIDE, &g_array_index (job->rows, guint, len));
+        g_array_set_size (job->rows, len + nrows);
+    }
+    g_free (query);
+
+    g_array_sort_with_data (job->rows, compare_rows, job);
+
+    /* apps which appear in more than one category are only listed once, at the highest rank - names are interned, so hash the pointers */
+    seen = g_hash_table_new (NULL, NULL);
+    for (i = 0, nrows = 0; i < job->rows->len; i++)
+    {
+        row = g_array_index (job->rows, guint, i);
+        entry = g_ptr_array_index (apps, row);
+        if (g_hash_table_add (seen, (gpointer) entry->name)) g_array_index (job->rows, guint, nrows++) = row;
+    }
+    g_array_set_size (job->rows, nrows);
+    g_hash_table_destroy (seen);
+
+    g_idle_add_full (G_PRIORITY_DEFAULT, apply_search_results, job, (GDestroyNotify) search_job_free);
+    TRACE_END (start, "search_apps");
+}
+
+/* Commands from PATH whose names start with the query go after the apps. The executable index belongs to the
+ * main thread and is shared with the Run dialog, so it is searched here - a binary search per directory in PATH. */
+
+static void add_command_results (MenuPlugin *m, GtkListStore *results, const char *query)
+{
+    ExecIndex *exec = exec_index_get ();
+    GPtrArray *names;
+    AppEntry *entry;
+    const char *name;
+    gsize len;
+    guint i;
+
+    /* the old results were cleared from the store by the caller */
+    g_ptr_array_set_size (m->commands, 0);
+    if (!exec || !*query) return;
+
+    names = exec_index_prefix (exec, query, SEARCH_MAX_COMMANDS);
+    for (i = 0; i < names->len; i++)
+    {
+        /* the name is copied, as the index may drop it while the results are shown */
+        name = g_ptr_array_index (names, i);
+        len = strlen (name) + 1;
+        entry = g_malloc0 (sizeof (AppEntry) + len);
+        memcpy (entry + 1, name, len);
+        entry->name = entry->id = (const char *) (entry + 1);
+        entry->icon = "utilities-terminal";
+        g_ptr_array_add (m->commands, entry);
+        gtk_list_store_insert_with_values (results, NULL, -1, 0, entry, -1);
+    }
+    g_ptr_array_unref (names);
+}
+
+/* Runs on the main thread - shows the results of a search unless they have been superseded */
+
+static gboolean apply_search_results (gpointer data)
+{
+    SearchJob *job = (SearchJob *) data;
+    MenuPlugin *m = (MenuPlugin *) job->state->plugin;
+    GtkListStore *results;
+    GtkTreePath *path;
+    guint i;
+
+    if (!m || !m->swin || job->gen != g_atomic_int_get (&m->search->gen) || job->index != m->index) return FALSE;
+
+    results = GTK_LIST_STORE (gtk_tree_view_get_model (GTK_TREE_VIEW (m->stv)));
+    gtk_list_store_clear (results);
+    for (i = 0; i < job->rows->len; i++)
+        gtk_list_store_insert_with_values (results, NULL, -1, 0, g_ptr_array_index (m->index->apps, g_array_index (job->rows, guint, i)), -1);
+    add_command_results (m, results, job->query);
+
+    path = gtk_tree_path_new_from_indices (0, -1);
+    gtk_tree_view_set_cursor (GTK_TREE_VIEW (m->stv), path, NULL, FALSE);
+    gtk_tree_path_free (path);
+
+    resize_search (m);
+    return FALSE;
 }
 
 static void append_to_entry (GtkWidget *entry, char val)
@@ -224,14 +475,21 @@ static void resize_search (MenuPlugin *m)
 
 static void handle_search_changed (GtkEditable *, gpointer user_data)
 {
+    TRACE_BEGIN (start);
     MenuPlugin *m = (MenuPlugin *) user_data;
-    GtkTreePath *path = gtk_tree_path_new_from_indices (0, -1);
-
-    gtk_tree_model_filter_refilter (GTK_TREE_MODEL_FILTER (gtk_tree_view_get_model (GTK_TREE_VIEW (m->stv))));
-    gtk_tree_view_set_cursor (GTK_TREE_VIEW (m->stv), path, NULL, FALSE);
-    gtk_tree_path_free (path);
-
-    resize_search (m);
+    SearchJob *job = g_new0 (SearchJob, 1);
+
+    /* bumping the generation cancels any search still in progress */
+    job->gen = g_atomic_int_add (&m->search->gen, 1) + 1;
+    g_atomic_int_inc (&m->search->ref);
+    job->state = m->search;
+    job->index = app_index_ref (m->index);
+    job->query = g_strdup (gtk_entry_get_text (GTK_ENTRY (m->srch)));
+    job->rows = g_array_new (FALSE, FALSE, sizeof (guint));
+    job->scores = search_scores (m);
+
+    g_thread_pool_push (m->search_pool, job, NULL);
+    TRACE_END (start, "handle_search_changed");
 }
 
 static gboolean handle_list_keypress (GtkWidget *, GdkEventKey *event, gpointer user_data)
@@ -269,8 +527,7 @@ static gboolean handle_search_keypress (GtkWidget *, GdkEventKey *event, gpointe
     GtkTreeModel *model;
     GtkTreeIter iter;
     GtkTreePath *path;
-    gchar *str;
-    FmPath *fpath;
+    AppEntry *entry;
     int nrows;
 
     switch (event->keyval)
@@ -279,10 +536,8 @@ static gboolean handle_search_keypress (GtkWidget *, GdkEventKey *event, gpointe
         case GDK_KEY_Return :   sel = gtk_tree_view_get_selection (GTK_TREE_VIEW (m->stv));
                                 if (gtk_tree_selection_get_selected (sel, &model, &iter))
                                 {
-                                    gtk_tree_model_get (model, &iter, 2, &str, -1);
-                                    fpath = fm_path_new_for_str (str);
-                                    fm_launch_path_simple (NULL, NULL, fpath, _open_dir_in_file_manager, NULL);
-                                    fm_path_unref (fpath);
+                                    gtk_tree_model_get (model, &iter, 0, &entry, -1);
+                                    launch_entry (m, entry);
                                 }
                                 destroy_search (m);
                                 return TRUE;
@@ -309,20 +564,38 @@ static void handle_list_select (GtkTreeView *tv, GtkTreePath *path, GtkTreeViewC
     MenuPlugin *m = (MenuPlugin *) user_data;
     GtkTreeModel *mod = gtk_tree_view_get_model (tv);
     GtkTreeIter iter;
-    gchar *str;
-    FmPath *fpath;
+    AppEntry *entry;
 
     if (gtk_tree_model_get_iter (mod, &iter, path))
     {
-        gtk_tree_model_get (mod, &iter, 2, &str, -1);
-        fpath = fm_path_new_for_str (str);
-        fm_launch_path_simple (NULL, NULL, fpath, _open_dir_in_file_manager, NULL);
-        fm_path_unref (fpath);
+        gtk_tree_model_get (mod, &iter, 0, &entry, -1);
+        launch_entry (m, entry);
     }
 
     destroy_search (m);
 }
 
+/* The highlighted result is the likely next launch, so start reading it from storage while the user decides */
+
+static void handle_search_cursor (GtkTreeView *tv, gpointer user_data)
+{
+    MenuPlugin *m = (MenuPlugin *) user_data;
+    GtkTreePath *path;
+    GtkTreeIter iter;
+    AppEntry *entry;
+
+    if (!m->warmup) return;
+    gtk_tree_view_get_cursor (tv, &path, NULL);
+    if (!path) return;
+    if (gtk_tree_model_get_iter (gtk_tree_view_get_model (tv), &iter, path))
+    {
+        gtk_tree_model_get (gtk_tree_view_get_model (tv), &iter, 0, &entry, -1);
+        if (entry->dir) warmup_request (entry->file, NULL);
+        else warmup_request (NULL, entry->name);
+    }
+    gtk_tree_path_free (path);
+}
+
 #ifdef LXPLUG
 static void handle_search_resize (GtkWidget *, GtkAllocation *, gpointer user_data)
 {
@@ -334,6 +607,25 @@ static void handle_search_resize (GtkWidget *, GtkAllocation *, gpointer user_da
 }
 #endif
 
+static void render_app_icon (G_GNUC_UNUSED GtkTreeViewColumn *col, GtkCellRenderer *cell, GtkTreeModel *model, GtkTreeIter *iter,
+    gpointer user_data)
+{
+    MenuPlugin *m = (MenuPlugin *) user_data;
+    AppEntry *entry;
+
+    gtk_tree_model_get (model, iter, 0, &entry, -1);
+    g_object_set (cell, "pixbuf", catalog_icon (m->catalog, entry->icon, item_icon_size (m)), NULL);
+}
+
+static void render_app_name (G_GNUC_UNUSED GtkTreeViewColumn *col, GtkCellRenderer *cell, GtkTreeModel *model, GtkTreeIter *iter,
+    G_GNUC_UNUSED gpointer user_data)
+{
+    AppEntry *entry;
+
+    gtk_tree_model_get (model, iter, 0, &entry, -1);
+    g_object_set (cell, "text", entry->name, NULL);
+}
+
 static void search_destroyed (GtkWidget *, gpointer data)
 {
     MenuPlugin *m = (MenuPlugin *) data;
@@ -341,13 +633,14 @@ static void search_destroyed (GtkWidget *, gpointer data)
     g_signal_handlers_disconnect_matched (m->srch, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, m);
     g_signal_handlers_disconnect_matched (m->stv, G_SIGNAL_MATCH_DATA, 0, 0, NULL, NULL, m);
     m->swin = NULL;
+    TRACE_FLUSH ();
 }
 
 static void create_search (MenuPlugin *m)
 {
+    TRACE_BEGIN (start);
     GtkCellRenderer *prend, *trend;
-    GtkTreeModelSort *slist;
-    GtkTreeModelFilter *flist;
+    GtkListStore *results;
     GtkWidget *box;
 
     /* create the window */
@@ -367,29 +660,30 @@ static void create_search (MenuPlugin *m)
     m->scr = gtk_scrolled_window_new (NULL, NULL);
 
     /* put in box in the appropriate order */
-    if (!m->fixed && wrap_is_at_bottom (m)) gtk_box_pack_start (GTK_BOX (box), m->scr, FALSE, FALSE, 0);
+    m->search_results_first = !m->fixed && wrap_is_at_bottom (m);
+    if (m->search_results_first) gtk_box_pack_start (GTK_BOX (box), m->scr, FALSE, FALSE, 0);
     gtk_box_pack_start (GTK_BOX (box), m->srch, FALSE, FALSE, 0);
-    if (m->fixed || !wrap_is_at_bottom (m)) gtk_box_pack_start (GTK_BOX (box), m->scr, FALSE, FALSE, 0);
+    if (!m->search_results_first) gtk_box_pack_start (GTK_BOX (box), m->scr, FALSE, FALSE, 0);
+
+    /* PATH is indexed once per session and shared with the Run dialog - this starts loading it if needed */
+    exec_index_get ();
 
-    /* create the filtered list for the tree view */
-    slist = GTK_TREE_MODEL_SORT (gtk_tree_model_sort_new_with_model (GTK_TREE_MODEL (m->applist)));
-    gtk_tree_sortable_set_sort_column_id (GTK_TREE_SORTABLE (slist), 1, GTK_SORT_ASCENDING);
-    flist = GTK_TREE_MODEL_FILTER (gtk_tree_model_filter_new (GTK_TREE_MODEL (slist), NULL));
-    gtk_tree_model_filter_set_visible_func (flist, (GtkTreeModelFilterVisibleFunc) filter_apps, m, NULL);
+    /* create the results list for the tree view - filled in by the search worker with pointers into the app index */
+    results = gtk_list_store_new (1, G_TYPE_POINTER);
 
     /* create the tree view */
-    m->stv = gtk_tree_view_new_with_model (GTK_TREE_MODEL (flist));
+    m->stv = gtk_tree_view_new_with_model (GTK_TREE_MODEL (results));
     g_signal_connect (m->stv, "key-press-event", G_CALLBACK (handle_list_keypress), m);
     g_signal_connect (m->stv, "row-activated", G_CALLBACK (handle_list_select), m);
+    g_signal_connect (m->stv, "cursor-changed", G_CALLBACK (handle_search_cursor), m);
     gtk_container_add (GTK_CONTAINER (m->scr), m->stv);
-    g_object_unref (slist);
-    g_object_unref (flist);
+    g_object_unref (results);
 
     /* set up the tree view */
     prend = gtk_cell_renderer_pixbuf_new ();
     trend = gtk_cell_renderer_text_new ();
-    gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (m->stv), -1, NULL, prend, "pixbuf", 0, NULL);
-    gtk_tree_view_insert_column_with_attributes (GTK_TREE_VIEW (m->stv), -1, NULL, trend, "text", 1, NULL);
+    gtk_tree_view_insert_column_with_data_func (GTK_TREE_VIEW (m->stv), -1, NULL, prend, render_app_icon, m, NULL);
+    gtk_tree_view_insert_column_with_data_func (GTK_TREE_VIEW (m->stv), -1, NULL, trend, render_app_name, NULL, NULL);
     gtk_tree_view_set_headers_visible (GTK_TREE_VIEW (m->stv), FALSE);
     gtk_tree_view_set_enable_search (GTK_TREE_VIEW (m->stv), FALSE);
 
@@ -405,22 +699,52 @@ static void create_search (MenuPlugin *m)
     /* resize window as needed */
     if (!m->fixed && panel_is_at_bottom (m->panel)) g_signal_connect (m->swin, "size-allocate", G_CALLBACK (handle_search_resize), m);
 #endif
+    TRACE_END (start, "create_search");
 }
 
 /* Handlers for system menu items */
 
-static void handle_menu_item_activate (GtkMenuItem *mi, MenuPlugin *)
+static void handle_menu_item_activate (GtkMenuItem *mi, MenuPlugin *m)
 {
-    FmFileInfo *fi = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
+    AppEntry *entry = g_object_get_qdata (G_OBJECT (mi), app_entry_quark);
+    const char *mpath = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
+    char *uri;
+
+    if (entry)
+    {
+        launch_entry (m, entry);
+        return;
+    }
 
-    fm_launch_path_simple (NULL, NULL, fm_file_info_get_path (fi), _open_dir_in_file_manager, NULL);
+    /* anything else is a directory, which opens in the file manager as libfm would have done, or an app with no entry,
+     * which is looked up by its id */
+    if (!mpath) return;
+    history_record (m->history, strrchr (mpath, '/') + 1);
+    clear_scores (m);
+    if (g_str_has_suffix (mpath, ".desktop"))
+    {
+        app_launch_file (NULL, mpath);
+        return;
+    }
+    uri = g_strconcat ("menu://applications", mpath + 13, NULL);
+    app_launch_folder (uri);
+    g_free (uri);
+}
+
+static void handle_menu_item_select (GtkMenuItem *mi, MenuPlugin *m)
+{
+    AppEntry *entry = g_object_get_qdata (G_OBJECT (mi), app_entry_quark);
+
+    if (m->warmup && entry) warmup_request (entry->file, NULL);
 }
 
 static void handle_menu_item_add_to_desktop (GtkMenuItem *, GtkWidget* mi)
 {
-    FmFileInfo *fi = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
-    FmPathList *files = fm_path_list_new ();
+    FmFileInfo *fi = menu_item_file_info (mi);
+    FmPathList *files;
 
+    if (!fi) return;
+    files = fm_path_list_new ();
     fm_path_list_push_tail (files, fm_file_info_get_path (fi));
     fm_link_files (NULL, files, fm_path_get_desktop ());
     fm_path_list_unref (files);
@@ -429,16 +753,18 @@ static void handle_menu_item_add_to_desktop (GtkMenuItem *, GtkWidget* mi)
 #ifndef LXPLUG
 static void handle_menu_item_add_to_launcher (GtkMenuItem *, GtkWidget* mi)
 {
-    FmFileInfo *fi = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
-    add_to_launcher (fm_file_info_get_name (fi));
+    FmFileInfo *fi = menu_item_file_info (mi);
+    if (fi) add_to_launcher (fm_file_info_get_name (fi));
 }
 #endif
 
 static void handle_menu_item_properties (GtkMenuItem *, GtkWidget* mi)
 {
-    FmFileInfo *fi = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
-    FmFileInfoList *files = fm_file_info_list_new ();
+    FmFileInfo *fi = menu_item_file_info (mi);
+    FmFileInfoList *files;
 
+    if (!fi) return;
+    files = fm_file_info_list_new ();
     fm_file_info_list_push_tail (files, fi);
     fm_show_file_properties (NULL, files);
     fm_file_info_list_unref (files);
@@ -453,9 +779,9 @@ static void handle_restore_submenu (GtkMenuItem *mi, GtkWidget *submenu)
 
 static void handle_menu_item_data_get (FmDndSrc *ds, GtkWidget *mi)
 {
-    FmFileInfo *fi = g_object_get_qdata (G_OBJECT (mi), sys_menu_item_quark);
+    FmFileInfo *fi = menu_item_file_info (mi);
 
-    fm_dnd_src_set_file (ds, fi);
+    if (fi) fm_dnd_src_set_file (ds, fi);
 }
 
 static void show_context_menu (GtkWidget* mi)
@@ -499,6 +825,11 @@ static gboolean handle_menu_item_button_press (GtkWidget* mi, GdkEventButton* ev
     if (evt->button == 1)
     {
         /* allow drag on clicked item */
+        if (!m->ds)
+        {
+            app_launch_fm_init ();
+            m->ds = fm_dnd_src_new (NULL);
+        }
         g_signal_handlers_disconnect_matched (m->ds, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, handle_menu_item_data_get, NULL);
         fm_dnd_src_set_widget (m->ds, mi);
         g_signal_connect (m->ds, "data-get", G_CALLBACK (handle_menu_item_data_get), mi);
@@ -579,15 +910,37 @@ static void handle_menu_item_gesture_pressed (GtkGestureLongPress *, gdouble, gd
 
 /* Functions to create system menu items */
 
-static GtkWidget *create_system_menu_item (MenuCacheItem *item, MenuPlugin *m)
+/* Menu item images only hold their icons while on screen, so the icon store can evict the rest when over budget. The
+ * icons are decoded as they are first shown, so after a rebuild that time counts towards the rebuild. */
+
+static void handle_menu_icon_map (GtkWidget *img, gpointer user_data)
+{
+    MenuPlugin *m = (MenuPlugin *) user_data;
+    const char *name = g_object_get_qdata (G_OBJECT (img), icon_name_quark);
+    gint64 start = m->timing_rebuild ? g_get_monotonic_time () : 0;
+    guint gen;
+
+    gtk_image_set_from_pixbuf (GTK_IMAGE (img), catalog_icon_acquire (m->catalog, name, m->menu_icon_size, &gen));
+    g_object_set_qdata (G_OBJECT (img), icon_gen_quark, GUINT_TO_POINTER (gen));
+    if (start) m->rebuild_time += g_get_monotonic_time () - start;
+}
+
+static void handle_menu_icon_unmap (GtkWidget *img, gpointer user_data)
 {
+    MenuPlugin *m = (MenuPlugin *) user_data;
+    const char *name = g_object_get_qdata (G_OBJECT (img), icon_name_quark);
+
+    gtk_image_clear (GTK_IMAGE (img));
+    catalog_icon_release (m->catalog, name, m->menu_icon_size,
+        GPOINTER_TO_UINT (g_object_get_qdata (G_OBJECT (img), icon_gen_quark)));
+}
+
+static GtkWidget *create_system_menu_item (const CatalogNode *node, MenuPlugin *m)
+{
+    TRACE_BEGIN (start);
     GtkWidget* mi, *img, *box, *label;
-    GdkPixbuf *icon;
-    FmPath *path;
-    FmFileInfo *fi;
-    char *mpath;
 
-    if (menu_cache_item_get_type (item) == MENU_CACHE_TYPE_SEP)
+    if (node->type == MENU_CACHE_TYPE_SEP)
     {
         mi = gtk_separator_menu_item_new ();
         g_object_set_qdata (G_OBJECT (mi), sys_menu_item_quark, GINT_TO_POINTER (1));
@@ -598,63 +951,31 @@ static GtkWidget *create_system_menu_item (MenuCacheItem *item, MenuPlugin *m)
         box = gtk_box_new (GTK_ORIENTATION_HORIZONTAL, MENU_ICON_SPACE);
         gtk_container_add (GTK_CONTAINER (mi), box);
 
+        /* icons come from the store shared with other instances, and are only set while the image is mapped */
         img = gtk_image_new ();
+        gtk_widget_set_size_request (img, item_icon_size (m), item_icon_size (m));
+        g_object_set_qdata (G_OBJECT (img), icon_name_quark, (gpointer) node->icon);
+        g_signal_connect (img, "map", G_CALLBACK (handle_menu_icon_map), m);
+        g_signal_connect (img, "unmap", G_CALLBACK (handle_menu_icon_unmap), m);
         gtk_container_add (GTK_CONTAINER (box), img);
 
-        label = gtk_label_new (menu_cache_item_get_name (item));
+        label = gtk_label_new (node->name);
         gtk_container_add (GTK_CONTAINER (box), label);
 
-        mpath = menu_cache_dir_make_path (MENU_CACHE_DIR (item));
-        path = fm_path_new_relative (fm_path_get_apps_menu (), mpath + 13);
-        g_free (mpath);
-
-        fi = fm_file_info_new_from_menu_cache_item (path, item);
-        g_object_set_qdata_full (G_OBJECT (mi), sys_menu_item_quark, fi, (GDestroyNotify) fm_file_info_unref);
+        /* the FmFileInfo for the item is only made from its path if the context menu or drag and drop need it - the
+         * path is held by the index, like the AppEntry */
+        g_object_set_qdata (G_OBJECT (mi), sys_menu_item_quark, (gpointer) node->path);
 
-#ifdef LXPLUG
-        FmIcon *fm_icon = fm_file_info_get_icon (fi);
-        if (fm_icon == NULL) fm_icon = fm_icon_from_name ("application-x-executable");
-        icon = fm_pixbuf_from_icon_with_fallback (fm_icon, panel_get_safe_icon_size (m->panel), "application-x-executable");
-        gtk_image_set_from_pixbuf (GTK_IMAGE (img), icon);
-#else
-        icon = NULL;
-        const char *icon_name = menu_cache_item_get_icon (item);
-        if (icon_name)
-        {
-            if (strstr (icon_name, "/"))
-                icon = gdk_pixbuf_new_from_file_at_size (icon_name, m->icon_size, m->icon_size, NULL);
-            else
-            {
-                icon = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (), icon_name,
-                    m->icon_size, GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
-
-                // fallback for packages using obsolete icon location
-                if (!icon)
-                {
-                    char *fname = g_strdup_printf ("/usr/share/pixmaps/%s", icon_name);
-                    icon = gdk_pixbuf_new_from_file_at_size (fname, m->icon_size, m->icon_size, NULL);
-                    g_free (fname);
-                }
-            }
-        }
-        if (!icon)
-            icon = gtk_icon_theme_load_icon (gtk_icon_theme_get_default (), "application-x-executable",
-                m->icon_size, GTK_ICON_LOOKUP_FORCE_SIZE, NULL);
-        if (icon) gtk_image_set_from_pixbuf (GTK_IMAGE (img), icon);
-#endif
-        if (menu_cache_item_get_type (item) == MENU_CACHE_TYPE_APP)
+        if (node->entry)
         {
-            mpath = fm_path_to_str (path);
-            gtk_list_store_insert_with_values (m->applist, NULL, -1, 0, icon, 1, menu_cache_item_get_name (item), 2, mpath, -1);
-            g_free (mpath);
+            g_object_set_qdata (G_OBJECT (mi), app_entry_quark, node->entry);
 
             gtk_widget_set_name (mi, "syssubmenu");
+            g_signal_connect (mi, "select", G_CALLBACK (handle_menu_item_select), m);
 #ifdef LXPLUG
             g_signal_connect (mi, "activate", G_CALLBACK (handle_menu_item_activate), m);
 #endif
         }
-        fm_path_unref (path);
-        if (icon) g_object_unref (icon);
 
         g_signal_connect (mi, "button-press-event", G_CALLBACK (handle_menu_item_button_press), m);
         gtk_drag_source_set (mi, GDK_BUTTON1_MASK, NULL, 0, GDK_ACTION_COPY);
@@ -668,51 +989,35 @@ static GtkWidget *create_system_menu_item (MenuCacheItem *item, MenuPlugin *m)
 #endif
     }
     gtk_widget_show_all (mi);
+    TRACE_END (start, "create_system_menu_item");
     return mi;
 }
 
-static int sys_menu_load_submenu (MenuPlugin* m, MenuCacheDir* dir, GtkWidget* menu, int pos)
+/* Builds the widgets for a run of catalog nodes; each directory's contents follow it, and are already known not to be empty */
+static void sys_menu_load_nodes (MenuPlugin *m, const CatalogNode *nodes, guint n, GtkWidget *menu, int pos)
 {
-    GSList *l, *children;
-    gint count = 0;
+    TRACE_BEGIN (start);
+    GtkWidget *mi, *sub;
+    guint i;
 
-    if (!menu_cache_dir_is_visible (dir)) return 0;
-
-    children = menu_cache_dir_list_children (dir);
-
-    for (l = children; l; l = l->next)
+    for (i = 0; i < n; i += 1 + nodes[i].size)
     {
-        MenuCacheItem* item = MENU_CACHE_ITEM (l->data);
-        if ((menu_cache_item_get_type (item) != MENU_CACHE_TYPE_APP) || (menu_cache_app_get_is_visible (MENU_CACHE_APP (item), SHOW_IN_LXDE)))
-        {
-            GtkWidget *mi = create_system_menu_item (item, m);
-            count++;
-            if (mi != NULL) gtk_menu_shell_insert ((GtkMenuShell*) menu, mi, pos);
-            if (pos >= 0) ++pos;
+        mi = create_system_menu_item (&nodes[i], m);
+        gtk_menu_shell_insert (GTK_MENU_SHELL (menu), mi, pos);
+        if (pos >= 0) ++pos;
 
-            /* process subentries */
-            if (menu_cache_item_get_type (item) == MENU_CACHE_TYPE_DIR)
-            {
-                GtkWidget* sub = gtk_menu_new ();
-                gtk_menu_set_reserve_toggle_size (GTK_MENU (sub), FALSE);
-                g_signal_connect (sub, "key-press-event", G_CALLBACK (handle_key_presses), m);
-                gint s_count = sys_menu_load_submenu (m, MENU_CACHE_DIR (item), sub, -1);
-                if (s_count)
-                {   
-                    gtk_widget_set_name (mi, "sysmenu");
-                    gtk_menu_item_set_submenu (GTK_MENU_ITEM (mi), sub);
-                }
-                else
-                {
-                    /* don't keep empty submenus */
-                    gtk_widget_destroy (sub);
-                    gtk_widget_destroy (mi);
-                    if (pos > 0) pos--;
-                }
-            }
+        /* process subentries */
+        if (nodes[i].type == MENU_CACHE_TYPE_DIR)
+        {
+            sub = gtk_menu_new ();
+            gtk_menu_set_reserve_toggle_size (GTK_MENU (sub), FALSE);
+            g_signal_connect (sub, "key-press-event", G_CALLBACK (handle_key_presses), m);
+            sys_menu_load_nodes (m, nodes + i + 1, nodes[i].size, sub, -1);
+            gtk_widget_set_name (mi, "sysmenu");
+            gtk_menu_item_set_submenu (GTK_MENU_ITEM (mi), sub);
         }
     }
-    return count;
+    TRACE_END (start, "sys_menu_load_nodes");
 }
 
 
@@ -720,21 +1025,27 @@ static int sys_menu_load_submenu (MenuPlugin* m, MenuCacheDir* dir, GtkWidget* m
 
 static void sys_menu_insert_items (MenuPlugin *m, GtkMenu *menu, int position)
 {
-    MenuCacheDir *dir;
+    gint64 start;
 
     if (G_UNLIKELY (sys_menu_item_quark == 0))
+    {
         sys_menu_item_quark = g_quark_from_static_string ("SysMenuItem");
+        file_info_quark = g_quark_from_static_string ("FileInfo");
+        app_entry_quark = g_quark_from_static_string ("AppEntry");
+        icon_name_quark = g_quark_from_static_string ("IconName");
+        icon_gen_quark = g_quark_from_static_string ("IconGen");
+    }
 
-    dir = menu_cache_dup_root_dir (m->menu_cache);
-
-    if (dir)
+    if (m->catalog->nodes)
     {
-        sys_menu_load_submenu (m, dir, GTK_WIDGET (menu), position);
-        menu_cache_item_unref (MENU_CACHE_ITEM (dir));
+        start = g_get_monotonic_time ();
+        sys_menu_load_nodes (m, (CatalogNode *) m->catalog->nodes->data, m->catalog->nodes->len, GTK_WIDGET (menu), position);
+        m->build_time = g_get_monotonic_time () - start;
+        g_debug ("system menu built in %" G_GINT64_FORMAT " ms", m->build_time / 1000);
     }
     else
     {
-        /* menu content is empty - add a place holder */
+        /* cache not loaded yet - add a place holder, which is replaced when the catalog says it is ready */
         GtkWidget* mi = gtk_menu_item_new ();
         g_object_set_qdata (G_OBJECT (mi), sys_menu_item_quark, GINT_TO_POINTER (1));
         gtk_menu_shell_insert (GTK_MENU_SHELL (menu), mi, position);
@@ -773,28 +1084,22 @@ static void reload_system_menu (MenuPlugin *m, GtkMenu *menu)
     g_list_free (children);
 }
 
-static void handle_reload_menu (MenuCache *, gpointer user_data)
+/* The catalog has been reloaded, or its icons have to be looked up again for a new theme */
+static void handle_catalog_changed (gpointer user_data)
 {
     MenuPlugin *m = (MenuPlugin *) user_data;
+    AppIndex *old = app_index_ref (m->index);
 
-    gtk_list_store_clear (m->applist);
-    reload_system_menu (m, GTK_MENU (m->menu));
+    /* the old menu items point into the old index, so it is kept until they have been destroyed */
+    clear_apps (m);
+    if (m->menu) reload_system_menu (m, GTK_MENU (m->menu));
+    app_index_unref (old);
 }
 
 static void read_system_menu (GtkMenu *menu, MenuPlugin *m)
 {
-    if (m->menu_cache == NULL)
-    {
-        gboolean need_prefix = (g_getenv ("XDG_MENU_PREFIX") == NULL);
-        m->menu_cache = menu_cache_lookup (need_prefix ? "lxde-applications.menu+hidden" : "applications.menu+hidden");
-        if (m->menu_cache == NULL)
-        {
-            g_warning ("error loading applications menu");
-            return;
-        }
-        m->reload_notify = menu_cache_add_reload_notify (m->menu_cache, handle_reload_menu, m);
-        sys_menu_insert_items (m, menu, -1);
-    }
+    /* if the catalog is not ready yet, the menu is built once when it is */
+    sys_menu_insert_items (m, menu, -1);
 }
 
 /* Functions to create individual menu items from panel config */
@@ -854,14 +1159,26 @@ static void handle_popped_up (GtkMenu *menu, gpointer, gpointer, gboolean, gbool
 
 static void mlogout (void)
 {
-    fm_launch_command_simple (NULL, NULL, 0, "lxde-pi-shutdown-helper", NULL);
+    app_launch_command (NULL, "lxde-pi-shutdown-helper", NULL, NULL);
+}
+
+/* Size of the icons in menu items and search results */
+static int item_icon_size (MenuPlugin *m)
+{
+#ifdef LXPLUG
+    return panel_get_safe_icon_size (m->panel);
+#else
+    return m->icon_size;
+#endif
 }
 
 /* Top level function to read in menu data from panel configuration */
 static gboolean create_menu (MenuPlugin *m)
 {
+    TRACE_BEGIN (start);
     GtkWidget *mi;
 
+    m->menu_icon_size = item_icon_size (m);
     m->menu = gtk_menu_new ();
     gtk_menu_set_reserve_toggle_size (GTK_MENU (m->menu), FALSE);
     gtk_container_set_border_width (GTK_CONTAINER (m->menu), 0);
@@ -871,6 +1188,7 @@ static gboolean create_menu (MenuPlugin *m)
 #else
     g_signal_connect (m->menu, "popped-up", G_CALLBACK (handle_popped_up), m);
 #endif
+    g_signal_connect (m->menu, "hide", G_CALLBACK (handle_menu_closed), m);
     read_system_menu (GTK_MENU (m->menu), m);
 
     mi = gtk_separator_menu_item_new ();
@@ -888,9 +1206,93 @@ static gboolean create_menu (MenuPlugin *m)
     gtk_widget_show (mi);
     gtk_menu_shell_append (GTK_MENU_SHELL (m->menu), mi);
 
+    TRACE_END (start, "create_menu");
     return TRUE;
 }
 
+/* Low-memory mode - only the catalog stays resident while the menu is closed, and the widgets are built again when
+ * it is next shown */
+
+static glong resident_kb (void)
+{
+    glong size, resident = 0;
+    FILE *fp = fopen ("/proc/self/statm", "r");
+
+    if (fp)
+    {
+        if (fscanf (fp, "%ld %ld", &size, &resident) != 2) resident = 0;
+        fclose (fp);
+    }
+    return resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+static gboolean release_menu (gpointer user_data)
+{
+    MenuPlugin *m = (MenuPlugin *) user_data;
+    glong before;
+
+    m->release_timer = 0;
+    if (!m->menu || gtk_widget_is_visible (m->menu)) return FALSE;
+
+    before = resident_kb ();
+    gtk_widget_destroy (m->menu);
+    m->menu = NULL;
+
+    /* icons still shown by other instances stay mapped, so are kept */
+    if (!m->keep_icons) catalog_trim_icons (m->catalog);
+#ifdef __GLIBC__
+    malloc_trim (0);
+#endif
+    m->released_kb = before - resident_kb ();
+    g_debug ("menu released, resident memory down %ld KiB", m->released_kb);
+    return FALSE;
+}
+
+static void handle_menu_closed (G_GNUC_UNUSED GtkWidget *menu, gpointer user_data)
+{
+    MenuPlugin *m = (MenuPlugin *) user_data;
+
+    TRACE_FLUSH ();
+
+    /* the rebuild is only complete once the icons it showed have been decoded, so that is what is held to the budget;
+     * decoding the icons is most of the work, so if that makes the menu slow to appear, only the widgets are released */
+    if (m->timing_rebuild)
+    {
+        m->timing_rebuild = FALSE;
+        g_debug ("released menu rebuilt and shown in %" G_GINT64_FORMAT " ms (%u rebuilds)", m->rebuild_time / 1000,
+            m->rebuilds);
+        if (m->rebuild_time > REBUILD_BUDGET && !m->keep_icons)
+        {
+            g_debug ("menu rebuild over budget - icons will be kept");
+            m->keep_icons = TRUE;
+        }
+    }
+
+    if (!m->low_memory) return;
+    if (m->release_timer) g_source_remove (m->release_timer);
+    m->release_timer = g_timeout_add_seconds (RELEASE_DELAY, release_menu, m);
+}
+
+/* Makes sure the menu is built before it is shown */
+static void ensure_menu (MenuPlugin *m)
+{
+    gint64 start;
+
+    if (m->release_timer)
+    {
+        g_source_remove (m->release_timer);
+        m->release_timer = 0;
+    }
+    if (m->menu) return;
+
+    /* the icons are decoded as the menu is shown, and added to the time until it is closed */
+    start = g_get_monotonic_time ();
+    create_menu (m);
+    m->rebuild_time = g_get_monotonic_time () - start;
+    m->rebuilds++;
+    m->timing_rebuild = TRUE;
+}
+
 /*----------------------------------------------------------------------------*/
 /* wf-panel plugin functions                                                  */
 /*----------------------------------------------------------------------------*/
@@ -899,6 +1301,7 @@ static gboolean create_menu (MenuPlugin *m)
 static void menu_button_clicked (GtkWidget *, MenuPlugin *m)
 {
     CHECK_LONGPRESS
+    ensure_menu (m);
     wrap_show_menu (m->plugin, m->menu);
 }
 
@@ -913,24 +1316,54 @@ void menu_update_display (MenuPlugin *m)
     }
     if (m->img) gtk_widget_set_size_request (m->img, wrap_icon_size (m) + 2 * m->padding, -1);
 
-    if (m->applist) gtk_list_store_clear (m->applist);
-    if (m->menu) gtk_widget_destroy (m->menu);
-    if (m->swin) destroy_search (m);
-    if (m->menu_cache)
+    /* an open search window only has to be remade if its layout has changed - otherwise it is just resized, with the
+     * row height measured again in case the icon size has changed */
+    if (m->swin)
     {
-        menu_cache_remove_reload_notify (m->menu_cache, m->reload_notify);
-        menu_cache_unref (m->menu_cache);
-        m->menu_cache = NULL;
+        if (m->search_results_first != (!m->fixed && wrap_is_at_bottom (m))) destroy_search (m);
+        else
+        {
+            m->rheight = 0;
+            gtk_widget_queue_resize (m->stv);
+            resize_search (m);
+        }
     }
+
+    /* nothing in the menu depends on the panel apart from the size of its icons, so it is only rebuilt if that changed;
+     * a released menu is built at the right size when it is next shown */
+    if (!m->menu || m->menu_icon_size == item_icon_size (m)) return;
+
+    /* the catalog and the search index are kept, so the new menu is built straight from the catalog's nodes */
+    gtk_widget_destroy (m->menu);
     create_menu (m);
 }
 
 /* Handler for control message */
 void menu_show_menu (MenuPlugin *m)
 {
-    if (gtk_widget_is_visible (m->menu)) gtk_menu_popdown (GTK_MENU (m->menu));
+    if (m->menu && gtk_widget_is_visible (m->menu)) gtk_menu_popdown (GTK_MENU (m->menu));
     else if (m->swin && gtk_widget_is_visible (m->swin)) destroy_search (m);
-    else wrap_show_menu (m->plugin, m->menu);
+    else
+    {
+        ensure_menu (m);
+        wrap_show_menu (m->plugin, m->menu);
+    }
+}
+
+/* Handler for low-memory mode being switched on or off */
+void menu_set_low_memory (MenuPlugin *m)
+{
+    if (!m->low_memory && m->release_timer)
+    {
+        g_source_remove (m->release_timer);
+        m->release_timer = 0;
+    }
+}
+
+/* Handler for icon memory budget update - the budget is in KiB, 0 for no limit */
+void menu_set_icon_budget (MenuPlugin *m)
+{
+    catalog_set_icon_budget (m->catalog, m->icon_budget > 0 ? (gsize) m->icon_budget * 1024 : 0);
 }
 
 /* Handler for padding update from variable watcher */
@@ -941,15 +1374,13 @@ void menu_set_padding (MenuPlugin *m)
 
 void menu_init (MenuPlugin *m)
 {
+    TRACE_INIT ();
+    TRACE_BEGIN (start);
+
     setlocale (LC_ALL, "");
     bindtextdomain (GETTEXT_PACKAGE, PACKAGE_LOCALE_DIR);
     bind_textdomain_codeset (GETTEXT_PACKAGE, "UTF-8");
 
-#ifndef LXPLUG
-    fm_gtk_init (NULL);
-    fm_init (NULL);
-#endif
-
     /* Allocate icon as a child of top level */
     m->img = gtk_image_new ();
     gtk_container_add (GTK_CONTAINER (m->plugin), m->img);
@@ -963,41 +1394,63 @@ void menu_init (MenuPlugin *m)
 
     /* Set up variables */
     m->icon = g_strdup ("start-here");
-    m->applist = gtk_list_store_new (3, GDK_TYPE_PIXBUF, G_TYPE_STRING, G_TYPE_STRING);
-    m->ds = fm_dnd_src_new (NULL);
+    m->catalog = catalog_ref ();
+    menu_set_icon_budget (m);
+    m->catalog_notify = catalog_add_notify (m->catalog, handle_catalog_changed, m);
+    m->index = app_index_ref (m->catalog->index);
+    m->search = g_new0 (SearchState, 1);
+    m->search->ref = 1;
+    m->search->plugin = m;
+    m->search_pool = g_thread_pool_new (search_apps, NULL, 1, FALSE, NULL);
+    m->history = history_open ("launches");
+    exec_index_ref ();
+    warmup_ref ();
+    m->commands = g_ptr_array_new_with_free_func (g_free);
+    m->ds = NULL;
     m->swin = NULL;
-    m->menu_cache = NULL;
 
     /* Load the menu configuration */
     create_menu (m);
 
-    /* Watch the icon theme and reload the menu if it changes */
-    g_signal_connect (gtk_icon_theme_get_default (), "changed", G_CALLBACK (handle_reload_menu), m);
-
     /* Show the widget and return */
     gtk_widget_show_all (m->plugin);
+    TRACE_END (start, "menu_init");
 }
 
 void menu_destructor (gpointer user_data)
 {
     MenuPlugin *m = (MenuPlugin *) user_data;
 
-    g_signal_handlers_disconnect_matched (m->ds, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, handle_menu_item_data_get, NULL);
-    g_object_unref (G_OBJECT (m->ds));
+    if (m->ds)
+    {
+        g_signal_handlers_disconnect_matched (m->ds, G_SIGNAL_MATCH_FUNC, 0, 0, NULL, handle_menu_item_data_get, NULL);
+        g_object_unref (G_OBJECT (m->ds));
+    }
 
     if (m->menu) gtk_widget_destroy (m->menu);
+    if (m->release_timer) g_source_remove (m->release_timer);
 #ifdef LXPLUG
     if (m->swin) destroy_search (m);
 #else
     close_popup ();
 #endif
-    if (m->menu_cache)
-    {
-        menu_cache_remove_reload_notify (m->menu_cache, m->reload_notify);
-        menu_cache_unref (m->menu_cache);
-    }
     g_free (m->icon);
 
+    /* cancel any search in progress and wait for the worker to drop out */
+    m->search->plugin = NULL;
+    g_atomic_int_inc (&m->search->gen);
+    g_thread_pool_free (m->search_pool, FALSE, TRUE);
+    if (g_atomic_int_dec_and_test (&m->search->ref)) g_free (m->search);
+    app_index_unref (m->index);
+    clear_scores (m);
+    catalog_remove_notify (m->catalog, m->catalog_notify);
+    catalog_unref (m->catalog);
+    exec_index_unref ();
+    warmup_unref ();
+    history_close (m->history);
+    g_ptr_array_unref (m->commands);
+    TRACE_FLUSH ();
+
 #ifndef LXPLUG
     if (m->migesture) g_object_unref (m->migesture);
 #endif
@@ -1026,6 +1479,9 @@ static GtkWidget *menu_constructor (LXPanel *panel, config_setting_t *settings)
     if (!config_setting_lookup_int (m->settings, "padding", &m->padding)) m->padding = 4;
     if (!config_setting_lookup_int (m->settings, "fixed", &m->fixed)) m->fixed = FALSE;
     if (!config_setting_lookup_int (m->settings, "height", &m->height)) m->height = 300;
+    if (!config_setting_lookup_int (m->settings, "warmup", &m->warmup)) m->warmup = FALSE;
+    if (!config_setting_lookup_int (m->settings, "low_memory", &m->low_memory)) m->low_memory = FALSE;
+    if (!config_setting_lookup_int (m->settings, "icon_budget", &m->icon_budget)) m->icon_budget = 8192;
 
     menu_init (m);
 
@@ -1066,8 +1522,13 @@ static gboolean menu_apply_config (gpointer user_data)
     config_group_set_int (m->settings, "padding", m->padding);
     config_group_set_int (m->settings, "fixed", m->fixed);
     config_group_set_int (m->settings, "height", m->height);
+    config_group_set_int (m->settings, "warmup", m->warmup);
+    config_group_set_int (m->settings, "low_memory", m->low_memory);
+    config_group_set_int (m->settings, "icon_budget", m->icon_budget);
 
     menu_set_padding (m);
+    menu_set_low_memory (m);
+    menu_set_icon_budget (m);
     return FALSE;
 }
 
@@ -1080,6 +1541,9 @@ static GtkWidget *menu_configure (LXPanel *panel, GtkWidget *plugin)
                                        _("Icon horizontal padding"), &m->padding, CONF_TYPE_INT,
                                        _("Fix height of search window"), &m->fixed, CONF_TYPE_BOOL,
                                        _("Search window height"), &m->height, CONF_TYPE_INT,
+                                       _("Preload apps when selected"), &m->warmup, CONF_TYPE_BOOL,
+                                       _("Release menu memory when closed"), &m->low_memory, CONF_TYPE_BOOL,
+                                       _("Icon memory budget (KiB)"), &m->icon_budget, CONF_TYPE_INT,
                                        NULL);
 }
 
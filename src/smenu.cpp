@@ -33,10 +33,13 @@ extern "C" {
     WayfireWidget *create () { return new WayfireSmenu; }
     void destroy (WayfireWidget *w) { delete w; }
 
-    static constexpr conf_table_t conf_table[4] = {
+    static constexpr conf_table_t conf_table[7] = {
         {CONF_INT,  "padding",          N_("Icon horizontal padding")},
         {CONF_BOOL, "search_fixed",     N_("Fix height of search window")},
         {CONF_INT,  "search_height",    N_("Search window height")},
+        {CONF_BOOL, "warmup",           N_("Preload apps when selected")},
+        {CONF_BOOL, "low_memory",       N_("Release menu memory when closed")},
+        {CONF_INT,  "icon_budget",      N_("Icon memory budget (KiB)")},
         {CONF_NONE, NULL,               NULL}
     };
     const conf_table_t *config_params (void) { return conf_table; };
@@ -50,23 +53,28 @@ void WayfireSmenu::bar_pos_changed_cb (void)
     else m->bottom = FALSE;
 }
 
-void WayfireSmenu::icon_size_changed_cb (void)
+/* Options often change together, so they are all applied in one update once the main loop is idle */
+void WayfireSmenu::settings_changed_cb (void)
 {
-    m->icon_size = icon_size;
-    menu_update_display (m);
+    if (!update_idle.connected ())
+        update_idle = Glib::signal_idle().connect (sigc::mem_fun (*this, &WayfireSmenu::update_display));
 }
 
-void WayfireSmenu::search_param_changed_cb (void)
+void WayfireSmenu::warmup_changed_cb (void)
 {
-    m->height = search_height;
-    m->fixed = search_fixed;
-    // no need to do anything here - will update when next opened
+    m->warmup = warmup;
 }
 
-void WayfireSmenu::padding_changed_cb (void)
+void WayfireSmenu::low_memory_changed_cb (void)
 {
-    m->padding = padding;
-    menu_set_padding (m);
+    m->low_memory = low_memory;
+    menu_set_low_memory (m);
+}
+
+void WayfireSmenu::icon_budget_changed_cb (void)
+{
+    m->icon_budget = icon_budget;
+    menu_set_icon_budget (m);
 }
 
 void WayfireSmenu::command (const char *cmd)
@@ -74,8 +82,14 @@ void WayfireSmenu::command (const char *cmd)
     if (!g_strcmp0 (cmd, "menu")) menu_show_menu (m);
 }
 
-bool WayfireSmenu::set_icon (void)
+bool WayfireSmenu::update_display (void)
 {
+    m->icon_size = icon_size;
+    m->padding = padding;
+    m->height = search_height;
+    m->fixed = search_fixed;
+
+    /* this only rebuilds the menu if the icon size has changed since it was built */
     menu_update_display (m);
     return false;
 }
@@ -94,27 +108,33 @@ void WayfireSmenu::init (Gtk::HBox *container)
     m->height = search_height;
     m->fixed = search_fixed;
     m->padding = padding;
-    icon_timer = Glib::signal_idle().connect (sigc::mem_fun (*this, &WayfireSmenu::set_icon));
+    m->warmup = warmup;
+    m->low_memory = low_memory;
+    m->icon_budget = icon_budget;
     bar_pos_changed_cb ();
 
     /* Add long press for right click */
     gesture = add_longpress_default (*plugin);
 
-    /* Initialise the plugin */
+    /* Initialise the plugin - this builds the menu, and the idle update then only has to set the icon */
     menu_init (m);
+    settings_changed_cb ();
 
     /* Setup callbacks */
-    icon_size.set_callback (sigc::mem_fun (*this, &WayfireSmenu::icon_size_changed_cb));
+    icon_size.set_callback (sigc::mem_fun (*this, &WayfireSmenu::settings_changed_cb));
     bar_pos.set_callback (sigc::mem_fun (*this, &WayfireSmenu::bar_pos_changed_cb));
 
-    search_height.set_callback (sigc::mem_fun (*this, &WayfireSmenu::search_param_changed_cb));
-    search_fixed.set_callback (sigc::mem_fun (*this, &WayfireSmenu::search_param_changed_cb));
-    padding.set_callback (sigc::mem_fun (*this, &WayfireSmenu::padding_changed_cb));
+    search_height.set_callback (sigc::mem_fun (*this, &WayfireSmenu::settings_changed_cb));
+    search_fixed.set_callback (sigc::mem_fun (*this, &WayfireSmenu::settings_changed_cb));
+    padding.set_callback (sigc::mem_fun (*this, &WayfireSmenu::settings_changed_cb));
+    warmup.set_callback (sigc::mem_fun (*this, &WayfireSmenu::warmup_changed_cb));
+    low_memory.set_callback (sigc::mem_fun (*this, &WayfireSmenu::low_memory_changed_cb));
+    icon_budget.set_callback (sigc::mem_fun (*this, &WayfireSmenu::icon_budget_changed_cb));
 }
 
 WayfireSmenu::~WayfireSmenu()
 {
-    icon_timer.disconnect ();
+    update_idle.disconnect ();
     menu_destructor (m);
 }
 
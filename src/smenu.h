@@ -29,6 +29,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 /* Typedefs and macros                                                        */
 /*----------------------------------------------------------------------------*/
 
+typedef struct
+{
+    gint ref;
+    gint gen;                       /* Generation of the newest search query */
+    gpointer plugin;                /* Owning MenuPlugin, NULL once destroyed */
+} SearchState;
+
 typedef struct 
 {
     GtkWidget *plugin;
@@ -48,15 +55,32 @@ typedef struct
     GtkWidget *srch;                /* Search window search bar */
     GtkWidget *stv;                 /* Search window tree view */
     GtkWidget *scr;                 /* Search window scrolled window */
-    GtkListStore *applist;
+    AppIndex *index;                /* All apps, for search */
+    SearchState *search;
+    GThreadPool *search_pool;
+    LaunchHistory *history;         /* Launch counts used to rank search results */
+    GArray *scores;                 /* Snapshot of the history score of each app in the index, for the search worker */
+    GPtrArray *commands;            /* AppEntry for each PATH command in the search results */
     char *icon;
     int padding;
     int height;
     int rheight;
+    gboolean search_results_first;  /* Set if the open search window has its results above the entry */
+    int menu_icon_size;             /* Size of the item icons the menu was built with */
     gboolean fixed;
+    gboolean warmup;                /* Read apps ahead into the page cache as they are selected */
+    gboolean low_memory;            /* Release the menu widgets and icons once the menu has been closed for a while */
+    gboolean keep_icons;            /* Set if rebuilding with icons took too long, so only widgets are released */
+    guint release_timer;
+    guint rebuilds;                 /* Number of times a released menu has been built again */
+    gint64 rebuild_time;            /* Microseconds taken by the last of those, including decoding the icons it showed */
+    gboolean timing_rebuild;        /* Set from a rebuild until the menu is closed, while icon decoding is timed */
+    glong released_kb;              /* Resident memory given back by the last release, in KiB */
+    int icon_budget;                /* Most memory for decoded icons, in KiB, or 0 for no limit */
 
-    MenuCache* menu_cache;
-    gpointer reload_notify;
+    Catalog *catalog;               /* Menu contents and icons, shared with other instances */
+    gpointer catalog_notify;
+    gint64 build_time;              /* Microseconds taken by the last build of the system menu */
     FmDndSrc *ds;
 } MenuPlugin;
 
@@ -67,6 +91,8 @@ typedef struct
 extern void menu_init (MenuPlugin *m);
 extern void menu_update_display (MenuPlugin *m);
 extern void menu_set_padding (MenuPlugin *m);
+extern void menu_set_low_memory (MenuPlugin *m);
+extern void menu_set_icon_budget (MenuPlugin *m);
 extern void menu_show_menu (MenuPlugin *m);
 extern void menu_destructor (gpointer user_data);
 
@@ -36,6 +36,10 @@ extern "C" {
 #include <menu-cache.h>
 #include <libfm/fm-gtk.h>
 #include "lxutils.h"
+#include "smatch.h"
+#include "strpool.h"
+#include "history.h"
+#include "catalog.h"
 #include "smenu.h"
 }
 
@@ -46,11 +50,14 @@ class WayfireSmenu : public WayfireWidget
 
     WfOption <int> icon_size {"panel/icon_size"};
     WfOption <std::string> bar_pos {"panel/position"};
-    sigc::connection icon_timer;
+    sigc::connection update_idle;
 
     WfOption <int> padding {"panel/smenu_padding"};
     WfOption <int> search_height {"panel/smenu_search_height"};
     WfOption <bool> search_fixed {"panel/smenu_search_fixed"};
+    WfOption <bool> warmup {"panel/smenu_warmup"};
+    WfOption <bool> low_memory {"panel/smenu_low_memory"};
+    WfOption <int> icon_budget {"panel/smenu_icon_budget"};
 
     /* plugin */
     MenuPlugin *m;
@@ -60,11 +67,12 @@ class WayfireSmenu : public WayfireWidget
     void init (Gtk::HBox *container) override;
     void command (const char *cmd) override;
     virtual ~WayfireSmenu ();
-    void icon_size_changed_cb (void);
     void bar_pos_changed_cb (void);
-    void search_param_changed_cb (void);
-    void padding_changed_cb (void);
-    bool set_icon (void);
+    void settings_changed_cb (void);
+    void warmup_changed_cb (void);
+    void low_memory_changed_cb (void);
+    void icon_budget_changed_cb (void);
+    bool update_display (void);
 };
 
 #endif /* end of include guard: WIDGETS_SMENU_HPP */
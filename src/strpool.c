@@ -0,0 +1,121 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <string.h>
+#include <glib.h>
+
+#include "strpool.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+#define STRPOOL_CHUNK 8192
+
+/* Anything bigger than this gets a block of its own rather than wasting the tail of the current one */
+#define STRPOOL_LARGE (STRPOOL_CHUNK / 4)
+
+#define STRPOOL_ALIGN(n) (((n) + sizeof (gpointer) - 1) & ~(sizeof (gpointer) - 1))
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+StrPool *strpool_new (void)
+{
+    StrPool *pool = g_new0 (StrPool, 1);
+    pool->table = g_hash_table_new (g_str_hash, g_str_equal);
+    return pool;
+}
+
+/* Everything allocated from the pool goes in one go */
+
+void strpool_free (StrPool *pool)
+{
+    g_hash_table_destroy (pool->table);
+    g_slist_free_full (pool->chunks, g_free);
+    g_free (pool);
+}
+
+gpointer strpool_alloc (StrPool *pool, gsize size)
+{
+    gpointer block;
+
+    size = STRPOOL_ALIGN (size);
+    if (size > STRPOOL_LARGE)
+    {
+        /* add behind the current block so that its free space is still used */
+        block = g_malloc (size);
+        if (pool->chunks) pool->chunks->next = g_slist_prepend (pool->chunks->next, block);
+        else pool->chunks = g_slist_prepend (NULL, block);
+        pool->total += size;
+        return block;
+    }
+
+    if (!pool->chunks || pool->used + size > pool->size)
+    {
+        pool->chunks = g_slist_prepend (pool->chunks, g_malloc (STRPOOL_CHUNK));
+        pool->used = 0;
+        pool->size = STRPOOL_CHUNK;
+        pool->total += STRPOOL_CHUNK;
+    }
+
+    block = (char *) pool->chunks->data + pool->used;
+    pool->used += size;
+    return block;
+}
+
+const char *strpool_intern (StrPool *pool, const char *str)
+{
+    return strpool_intern_len (pool, str, strlen (str));
+}
+
+/* Intern the first len bytes of str - lets a prefix be shared without copying it first */
+
+const char *strpool_intern_len (StrPool *pool, const char *str, gsize len)
+{
+    char buf[256], *key, *res;
+
+    if (len < sizeof (buf)) key = buf;
+    else key = g_malloc (len + 1);
+    memcpy (key, str, len);
+    key[len] = 0;
+
+    res = g_hash_table_lookup (pool->table, key);
+    if (!res)
+    {
+        res = strpool_alloc (pool, len + 1);
+        memcpy (res, key, len + 1);
+        g_hash_table_add (pool->table, res);
+    }
+
+    if (key != buf) g_free (key);
+    return res;
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
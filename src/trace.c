@@ -0,0 +1,216 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <glib.h>
+
+#include "trace.h"
+
+#ifdef SMENU_TRACE
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+/* Events per chunk, and the most chunks one thread may fill before further events are dropped */
+#define TRACE_CHUNK         1024
+#define TRACE_MAX_CHUNKS    64
+
+typedef struct
+{
+    const char *name;
+    gint64 ts;                      /* Start of the span, in microseconds of monotonic time */
+    gint64 dur;
+} TraceEvent;
+
+/* Only the owning thread writes to a chunk; the count is published after each event is filled in, so a flush
+ * running alongside reads only complete events */
+typedef struct _TraceChunk
+{
+    struct _TraceChunk *next;
+    gint count;
+    TraceEvent events[TRACE_CHUNK];
+} TraceChunk;
+
+/* One buffer per thread which has recorded a span, kept until the process exits */
+typedef struct _TraceBuffer
+{
+    struct _TraceBuffer *next;
+    TraceChunk *first;
+    TraceChunk *last;
+    guint nchunks;
+    gint dropped;
+    guint tid;
+    char name[16];
+} TraceBuffer;
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+static char *trace_file;            /* File named by SMENU_TRACE, or NULL if tracing is off */
+static TraceBuffer *buffers;        /* All thread buffers, newest first */
+static gint recorded;               /* Events recorded so far, to skip flushes with nothing new */
+static gint flushed;
+
+static _Thread_local TraceBuffer *local;
+
+/*----------------------------------------------------------------------------*/
+/* Prototypes                                                                 */
+/*----------------------------------------------------------------------------*/
+
+static TraceBuffer *trace_buffer_new (void);
+static void append_name (GString *json, const char *name);
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+void trace_init (void)
+{
+    static gsize init = 0;
+    const char *env;
+
+    if (!g_once_init_enter (&init)) return;
+    env = g_getenv ("SMENU_TRACE");
+    if (env && *env) trace_file = g_strdup (env);
+    g_once_init_leave (&init, 1);
+}
+
+/* Returns the start time for a span, or 0 if tracing is off so that the span is not recorded */
+gint64 trace_now (void)
+{
+    return trace_file ? g_get_monotonic_time () : 0;
+}
+
+static TraceBuffer *trace_buffer_new (void)
+{
+    TraceBuffer *buf = g_new0 (TraceBuffer, 1);
+
+    buf->first = buf->last = g_new0 (TraceChunk, 1);
+    buf->nchunks = 1;
+    buf->tid = syscall (SYS_gettid);
+    if (pthread_getname_np (pthread_self (), buf->name, sizeof (buf->name))) buf->name[0] = 0;
+
+    /* push onto the list of buffers without a lock - buffers are never removed, so there is no ABA problem */
+    do buf->next = g_atomic_pointer_get (&buffers);
+    while (!g_atomic_pointer_compare_and_exchange (&buffers, buf->next, buf));
+    return buf;
+}
+
+void trace_span (const char *name, gint64 start)
+{
+    TraceChunk *chunk;
+    TraceEvent *ev;
+    gint64 end;
+
+    if (!start) return;
+    end = g_get_monotonic_time ();
+    if (!local) local = trace_buffer_new ();
+
+    chunk = local->last;
+    if (chunk->count == TRACE_CHUNK)
+    {
+        if (local->nchunks == TRACE_MAX_CHUNKS)
+        {
+            g_atomic_int_inc (&local->dropped);
+            return;
+        }
+        chunk = g_new0 (TraceChunk, 1);
+        g_atomic_pointer_set (&local->last->next, chunk);
+        local->last = chunk;
+        local->nchunks++;
+    }
+
+    ev = &chunk->events[chunk->count];
+    ev->name = name;
+    ev->ts = start;
+    ev->dur = end - start;
+    g_atomic_int_set (&chunk->count, chunk->count + 1);
+    g_atomic_int_inc (&recorded);
+}
+
+/* Thread names are set by whoever made the thread, so anything which would need escaping in JSON is replaced */
+static void append_name (GString *json, const char *name)
+{
+    for (; *name; name++) g_string_append_c (json, *name == '"' || *name == '\\' || (guchar) *name < ' ' ? '_' : *name);
+}
+
+/* Writes everything recorded so far as Chrome trace event JSON, which Perfetto can also load; this replaces the
+ * file each time, so it is only done from the main thread when the menu or search window closes */
+void trace_flush (void)
+{
+    TraceBuffer *buf;
+    TraceChunk *chunk;
+    GString *json;
+    GError *err = NULL;
+    gint count, pid = getpid ();
+    gint i;
+
+    count = g_atomic_int_get (&recorded);
+    if (!trace_file || count == flushed) return;
+    flushed = count;
+
+    json = g_string_new ("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (buf = g_atomic_pointer_get (&buffers); buf; buf = buf->next)
+    {
+        g_string_append_printf (json, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%u,\"args\":{\"name\":\"",
+            pid, buf->tid);
+        append_name (json, buf->name[0] ? buf->name : "smenu");
+        g_string_append (json, "\"}},\n");
+
+        if (g_atomic_int_get (&buf->dropped))
+            g_string_append_printf (json, "{\"name\":\"dropped\",\"ph\":\"C\",\"ts\":%" G_GINT64_FORMAT ",\"pid\":%d,"
+                "\"tid\":%u,\"args\":{\"events\":%d}},\n", g_get_monotonic_time (), pid, buf->tid, g_atomic_int_get (&buf->dropped));
+
+        for (chunk = buf->first; chunk; chunk = g_atomic_pointer_get (&chunk->next))
+        {
+            count = g_atomic_int_get (&chunk->count);
+            for (i = 0; i < count; i++)
+                g_string_append_printf (json, "{\"name\":\"%s\",\"cat\":\"smenu\",\"ph\":\"X\",\"ts\":%" G_GINT64_FORMAT
+                    ",\"dur\":%" G_GINT64_FORMAT ",\"pid\":%d,\"tid\":%u},\n", chunk->events[i].name, chunk->events[i].ts,
+                    chunk->events[i].dur, pid, buf->tid);
+        }
+    }
+
+    /* every event line ends with a comma, which JSON does not allow after the last one */
+    if (g_str_has_suffix (json->str, ",\n")) g_string_truncate (json, json->len - 2);
+    g_string_append (json, "\n]}\n");
+    if (!g_file_set_contents (trace_file, json->str, json->len, &err))
+    {
+        g_warning ("unable to write trace to %s : %s", trace_file, err->message);
+        g_error_free (err);
+    }
+    g_string_free (json, TRUE);
+}
+
+#endif
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
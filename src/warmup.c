@@ -0,0 +1,280 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <fcntl.h>
+#include <link.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <glib.h>
+#include <gio/gio.h>
+#include <gio/gdesktopappinfo.h>
+
+#include "warmup.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+/* How long the selection must rest on an item before it is warmed up, in ms */
+#define WARMUP_DELAY        120
+
+/* Most files read ahead for one app - the binary and its libraries */
+#define WARMUP_MAX_FILES    64
+
+#if __SIZEOF_POINTER__ == 8
+#define ELF_NATIVE_CLASS    ELFCLASS64
+#else
+#define ELF_NATIVE_CLASS    ELFCLASS32
+#endif
+
+typedef struct
+{
+    char *file;                     /* Desktop file, or NULL */
+    char *command;                  /* Command to find in PATH if there is no desktop file */
+    gint gen;                       /* Generation when requested - stale once the selection moves */
+} WarmupJob;
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+/* Directories searched for shared libraries, in the order the Debian loader uses */
+static const char *lib_dirs[] =
+{
+    "/usr/local/lib",
+    "/lib/aarch64-linux-gnu", "/usr/lib/aarch64-linux-gnu",
+    "/lib/arm-linux-gnueabihf", "/usr/lib/arm-linux-gnueabihf",
+    "/lib/x86_64-linux-gnu", "/usr/lib/x86_64-linux-gnu",
+    "/lib", "/usr/lib",
+    NULL
+};
+
+static GThreadPool *pool;
+static gint gen;
+static guint timer;
+static gint users;
+static char *pending_file, *pending_command;
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+/* Add the DT_NEEDED entries of a mapped ELF file of the native class to names */
+
+static void elf_needed (const char *data, gsize size, GPtrArray *names)
+{
+    const ElfW(Ehdr) *eh = (const ElfW(Ehdr) *) data;
+    const ElfW(Phdr) *ph;
+    const ElfW(Dyn) *dyn = NULL;
+    const char *name;
+    gsize ndyn = 0, strtab = 0, addr = 0, i;
+
+    if (size < sizeof (ElfW(Ehdr)) || memcmp (eh->e_ident, ELFMAG, SELFMAG) || eh->e_ident[EI_CLASS] != ELF_NATIVE_CLASS) return;
+    if (eh->e_phoff + eh->e_phnum * sizeof (ElfW(Phdr)) > size) return;
+    ph = (const ElfW(Phdr) *) (data + eh->e_phoff);
+
+    for (i = 0; i < eh->e_phnum; i++)
+    {
+        if (ph[i].p_type == PT_DYNAMIC && ph[i].p_offset + ph[i].p_filesz <= size)
+        {
+            dyn = (const ElfW(Dyn) *) (data + ph[i].p_offset);
+            ndyn = ph[i].p_filesz / sizeof (ElfW(Dyn));
+        }
+    }
+    for (i = 0; i < ndyn && dyn[i].d_tag != DT_NULL; i++)
+        if (dyn[i].d_tag == DT_STRTAB) addr = dyn[i].d_un.d_ptr;
+    if (!addr) return;
+
+    /* the string table is given as a virtual address, so find the segment holding it to get the file offset */
+    for (i = 0; i < eh->e_phnum; i++)
+        if (ph[i].p_type == PT_LOAD && addr >= ph[i].p_vaddr && addr < ph[i].p_vaddr + ph[i].p_filesz)
+            strtab = addr - ph[i].p_vaddr + ph[i].p_offset;
+    if (!strtab || strtab >= size) return;
+
+    for (i = 0; i < ndyn && dyn[i].d_tag != DT_NULL; i++)
+    {
+        if (dyn[i].d_tag != DT_NEEDED || strtab + dyn[i].d_un.d_val >= size) continue;
+        name = data + strtab + dyn[i].d_un.d_val;
+        if (memchr (name, 0, size - (name - data))) g_ptr_array_add (names, g_strdup (name));
+    }
+}
+
+/* Ask the kernel to start reading a file into the page cache, and collect the libraries it needs */
+
+static void warm_file (const char *path, GPtrArray *needed)
+{
+    struct stat st;
+    gpointer map;
+    int fd;
+
+    fd = open (path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+    posix_fadvise (fd, 0, 0, POSIX_FADV_WILLNEED);
+
+    if (needed && fstat (fd, &st) == 0 && st.st_size > 0)
+    {
+        /* only the headers and dynamic section are touched, which the read ahead has already asked for */
+        map = mmap (NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED)
+        {
+            elf_needed ((const char *) map, st.st_size, needed);
+            munmap (map, st.st_size);
+        }
+    }
+    close (fd);
+}
+
+static char *find_library (const char *name)
+{
+    const char **dir;
+    char *path;
+
+    if (strchr (name, '/')) return g_strdup (name);
+    for (dir = lib_dirs; *dir; dir++)
+    {
+        path = g_build_filename (*dir, name, NULL);
+        if (access (path, R_OK) == 0) return path;
+        g_free (path);
+    }
+    return NULL;
+}
+
+static gboolean job_stale (WarmupJob *job)
+{
+    return g_atomic_int_get (&gen) != job->gen;
+}
+
+/* Runs in the warm-up thread - works through the binary and its libraries breadth first, stopping if the selection moves */
+
+static void warmup_thread (gpointer data, G_GNUC_UNUSED gpointer user_data)
+{
+    WarmupJob *job = (WarmupJob *) data;
+    GDesktopAppInfo *info;
+    GHashTable *seen;
+    GPtrArray *queue;
+    char *exec = NULL, *path;
+    guint i;
+
+    if (job->file && !job_stale (job))
+    {
+        warm_file (job->file, NULL);
+        info = g_desktop_app_info_new_from_filename (job->file);
+        if (info)
+        {
+            exec = g_strdup (g_app_info_get_executable (G_APP_INFO (info)));
+            g_object_unref (info);
+        }
+    }
+    else exec = g_strdup (job->command);
+
+    path = exec && !job_stale (job) ? g_find_program_in_path (exec) : NULL;
+    if (path)
+    {
+        seen = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+        queue = g_ptr_array_new_with_free_func (g_free);
+        g_ptr_array_add (queue, path);
+        for (i = 0; i < queue->len && i < WARMUP_MAX_FILES && !job_stale (job); i++)
+        {
+            /* the first entry is the binary itself, the rest are library names from DT_NEEDED */
+            path = i ? find_library (g_ptr_array_index (queue, i)) : g_strdup (path);
+            if (path && g_hash_table_add (seen, path)) warm_file (path, queue);
+        }
+        g_hash_table_destroy (seen);
+        g_ptr_array_unref (queue);
+    }
+
+    g_free (exec);
+    g_free (job->file);
+    g_free (job->command);
+    g_free (job);
+}
+
+static gboolean warmup_start (G_GNUC_UNUSED gpointer data)
+{
+    WarmupJob *job = g_new0 (WarmupJob, 1);
+
+    job->file = pending_file;
+    job->command = pending_command;
+    job->gen = g_atomic_int_get (&gen);
+    pending_file = pending_command = NULL;
+
+    if (!pool) pool = g_thread_pool_new (warmup_thread, NULL, 1, FALSE, NULL);
+    g_thread_pool_push (pool, job, NULL);
+    timer = 0;
+    return FALSE;
+}
+
+/* Called as the selection moves onto an app, given its desktop file or otherwise its command - the work is
+ * started once the selection has rested there for a moment */
+
+void warmup_request (const char *file, const char *command)
+{
+    warmup_cancel ();
+    if (!file && !command) return;
+
+    pending_file = g_strdup (file);
+    pending_command = g_strdup (command);
+    timer = g_timeout_add (WARMUP_DELAY, warmup_start, NULL);
+}
+
+/* Each plugin instance holds a reference; the last one to go waits for the thread to finish, so that nothing is
+ * left running in the module once it is unloaded */
+
+void warmup_ref (void)
+{
+    users++;
+}
+
+void warmup_unref (void)
+{
+    if (--users) return;
+
+    /* any queued jobs are now stale, so they return straight away */
+    warmup_cancel ();
+    if (pool) g_thread_pool_free (pool, FALSE, TRUE);
+    pool = NULL;
+}
+
+/* Stop any warm-up pending or in progress */
+
+void warmup_cancel (void)
+{
+    g_atomic_int_inc (&gen);
+    if (timer)
+    {
+        g_source_remove (timer);
+        timer = 0;
+    }
+    g_free (pending_file);
+    g_free (pending_command);
+    pending_file = pending_command = NULL;
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
@@ -0,0 +1,104 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "smatch.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+#define BENCH_SEED      0x534d4154
+
+/* Roughly a full desktop's worth of apps, listed once per category they are in */
+#define BENCH_NAMES     2000
+#define BENCH_RUNS      2000
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+static const char *words[] =
+{
+    "Text", "Editor", "Terminal", "File", "Manager", "Image", "Viewer", "Web", "Browser", "Media", "Player",
+    "Calculator", "Settings", "Screen", "Reader", "Office", "Writer", "Sound", "Recorder", "Python", "Thonny",
+    "Chromium", "Firefox", "Mail", "Archive", "Task", "Monitor", "Printer", "Bluetooth", "Network", "Help"
+};
+
+/* Typing a name a letter at a time, and a few which match nothing */
+static const char *queries[] = { "t", "te", "ter", "term", "termi", "c", "ch", "chr", "xyz", "qq", "viewer" };
+
+static const SMatchKernel kernels[] = { SMATCH_SCALAR, SMATCH_SSE2, SMATCH_AVX2, SMATCH_NEON };
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+int main (void)
+{
+    GRand *rand = g_rand_new_with_seed (BENCH_SEED);
+    unsigned rows[BENCH_NAMES], n = 0;
+    GString *name = g_string_new (NULL);
+    gint64 start, elapsed;
+    int i, j, k, run;
+    SMatchBuf b;
+
+    smatch_init (&b);
+    for (i = 0; i < BENCH_NAMES; i++)
+    {
+        g_string_truncate (name, 0);
+        for (j = g_rand_int_range (rand, 1, 4); j; j--)
+            g_string_append_printf (name, "%s%s", name->len ? " " : "", words[g_rand_int_range (rand, 0, G_N_ELEMENTS (words))]);
+        smatch_add (&b, name->str);
+    }
+    printf ("%u names, %zu bytes\n", b.count, b.len);
+
+    for (k = 0; k < (int) G_N_ELEMENTS (kernels); k++)
+    {
+        if (!smatch_set_kernel (kernels[k])) continue;
+
+        start = g_get_monotonic_time ();
+        for (run = 0; run < BENCH_RUNS; run++)
+            for (j = 0; j < (int) G_N_ELEMENTS (queries); j++) n += smatch_scan (&b, queries[j], 0, b.count, rows);
+        elapsed = g_get_monotonic_time () - start;
+
+        printf ("%-8s %8.2f us per scan\n", smatch_kernel_name (), (double) elapsed / (BENCH_RUNS * G_N_ELEMENTS (queries)));
+    }
+
+    /* the total is printed so that the scans cannot be optimised away */
+    printf ("%u matches\n", n);
+    smatch_free (&b);
+    g_string_free (name, TRUE);
+    g_rand_free (rand);
+    return 0;
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/
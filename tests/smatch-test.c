@@ -0,0 +1,213 @@
+/*============================================================================
+Copyright (c) 2025 Raspberry Pi Holdings Ltd.
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+    * Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+    * Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+    * Neither the name of the copyright holder nor the
+      names of its contributors may be used to endorse or promote products
+      derived from this software without specific prior written permission.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY
+DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+============================================================================*/
+
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+
+#include "smatch.h"
+
+/*----------------------------------------------------------------------------*/
+/* Typedefs and macros                                                        */
+/*----------------------------------------------------------------------------*/
+
+/* Fixed, so that a failure can be reproduced */
+#define TEST_SEED       0x534d4154
+
+#define TEST_ROUNDS     200
+#define TEST_NAMES      600
+#define TEST_QUERIES    50
+
+/* Filler before a needle in the boundary test, enough to carry it across the first two 32-byte blocks */
+#define TEST_LEAD       72
+
+/*----------------------------------------------------------------------------*/
+/* Global data                                                                */
+/*----------------------------------------------------------------------------*/
+
+/* A small alphabet makes partial matches, and so the verification step, common. Names are case-folded UTF-8, so
+ * there are multi-byte characters too, which share lead bytes and which folding must leave alone. */
+static const char *const alphabet[] = { "a", "b", "c", "d", "e", "A", "B", "C", "D", "E", " ", "-", ".",
+    "\xc3\xa9", "\xc3\x89", "\xc3\x9f", "\xe2\x82\xac", "\xe6\x97\xa5" };
+
+/* Needles for the boundary test, including ones made of or ending in multi-byte characters */
+static const char *const needles[] = { "cab", "a\xc3\xa9", "\xc3\xa9\xe2\x82\xac", "d\xe6\x97\xa5" "e",
+    "\xc3\x9f" };
+
+static const SMatchKernel kernels[] = { SMATCH_SSE2, SMATCH_AVX2, SMATCH_NEON };
+
+/*----------------------------------------------------------------------------*/
+/* Function definitions                                                       */
+/*----------------------------------------------------------------------------*/
+
+/* Fills str with len bytes of whole characters */
+static void random_string (GRand *rand, char *str, int len)
+{
+    const char *ch;
+    int n = 0, clen;
+
+    while (n < len)
+    {
+        ch = alphabet[g_rand_int_range (rand, 0, G_N_ELEMENTS (alphabet))];
+        clen = strlen (ch);
+        if (n + clen > len) continue;
+        memcpy (str + n, ch, clen);
+        n += clen;
+    }
+    str[n] = 0;
+}
+
+/* Queries are mostly taken from the names, so that most of them match something */
+static void random_query (GRand *rand, const SMatchBuf *b, char *query)
+{
+    const char *name;
+    int len, pos;
+
+    len = g_rand_int_range (rand, 1, 9);
+    name = b->buf + b->offsets[g_rand_int_range (rand, 0, b->count)];
+    if (g_rand_boolean (rand) && (int) strlen (name) >= len)
+    {
+        pos = g_rand_int_range (rand, 0, strlen (name) - len + 1);
+        memcpy (query, name + pos, len);
+        query[len] = 0;
+    }
+    else
+    {
+        random_string (rand, query, len);
+        smatch_fold (query, query, len + 1);
+    }
+}
+
+static int compare_kernel (SMatchKernel kernel, const SMatchBuf *b, const char *query, unsigned first, unsigned last,
+    unsigned *expect, unsigned nexpect, unsigned *rows)
+{
+    unsigned n;
+
+    smatch_set_kernel (kernel);
+    n = smatch_scan (b, query, first, last, rows);
+    if (n == nexpect && !memcmp (rows, expect, n * sizeof (unsigned))) return 1;
+
+    fprintf (stderr, "%s kernel differs from scalar for \"%s\" in rows %u to %u : %u rows, expected %u\n",
+        smatch_kernel_name (), query, first, last, n, nexpect);
+    return 0;
+}
+
+/* Each needle is put after every length of filler up to TEST_LEAD, so that it straddles the 16 and 32-byte block
+ * boundaries at every offset, in rows which start at every alignment; rows with all but the last byte of it are
+ * mixed in, so that a partial match sits on each boundary too. Every row with the whole needle must be found. */
+static int test_boundaries (void)
+{
+    unsigned expect[2 * (TEST_LEAD + 1)], rows[2 * (TEST_LEAD + 1)];
+    char name[TEST_LEAD + 16], needle[16];
+    unsigned nexpect;
+    int n, lead, k, failed = 0;
+    size_t len;
+    SMatchBuf b;
+
+    for (n = 0; n < (int) G_N_ELEMENTS (needles) && !failed; n++)
+    {
+        smatch_fold (needle, needles[n], sizeof (needle));
+        len = strlen (needle);
+
+        smatch_init (&b);
+        for (lead = 0; lead <= TEST_LEAD; lead++)
+        {
+            memset (name, 'x', lead);
+            memcpy (name + lead, needle, len);
+            strcpy (name + lead + len, "xxxxx");
+            smatch_add (&b, name);
+            name[lead + len - 1] = 'x';
+            smatch_add (&b, name);
+        }
+
+        smatch_set_kernel (SMATCH_SCALAR);
+        nexpect = smatch_scan (&b, needle, 0, b.count, expect);
+        if (nexpect != TEST_LEAD + 1)
+        {
+            fprintf (stderr, "scalar kernel found %u rows for needle %d, expected %u\n", nexpect, n, TEST_LEAD + 1);
+            failed = 1;
+        }
+
+        for (k = 0; k < (int) G_N_ELEMENTS (kernels); k++)
+            if (smatch_set_kernel (kernels[k])
+                && !compare_kernel (kernels[k], &b, needle, 0, b.count, expect, nexpect, rows)) failed = 1;
+        smatch_free (&b);
+    }
+    return failed;
+}
+
+int main (void)
+{
+    GRand *rand = g_rand_new_with_seed (TEST_SEED);
+    unsigned expect[TEST_NAMES], rows[TEST_NAMES];
+    char name[80], query[16];
+    unsigned first, last, nexpect;
+    int round, i, k, nkernels = 0, failed = 0;
+    SMatchBuf b;
+
+    for (k = 0; k < (int) G_N_ELEMENTS (kernels); k++)
+    {
+        if (!smatch_set_kernel (kernels[k])) continue;
+        printf ("testing %s kernel\n", smatch_kernel_name ());
+        nkernels++;
+    }
+
+    failed = test_boundaries ();
+
+    for (round = 0; round < TEST_ROUNDS && !failed; round++)
+    {
+        /* names of every length up to several vector widths, including empty ones */
+        smatch_init (&b);
+        for (i = 0; i < TEST_NAMES; i++)
+        {
+            random_string (rand, name, g_rand_int_range (rand, 0, sizeof (name) - 1));
+            smatch_add (&b, name);
+        }
+
+        for (i = 0; i < TEST_QUERIES && !failed; i++)
+        {
+            random_query (rand, &b, query);
+            first = g_rand_int_range (rand, 0, TEST_NAMES);
+            last = g_rand_int_range (rand, first + 1, TEST_NAMES + 1);
+
+            smatch_set_kernel (SMATCH_SCALAR);
+            nexpect = smatch_scan (&b, query, first, last, expect);
+
+            for (k = 0; k < (int) G_N_ELEMENTS (kernels); k++)
+                if (smatch_set_kernel (kernels[k])
+                    && !compare_kernel (kernels[k], &b, query, first, last, expect, nexpect, rows)) failed = 1;
+        }
+        smatch_free (&b);
+    }
+
+    g_rand_free (rand);
+    if (!nkernels) printf ("no vector kernels on this CPU - only the scalar kernel was run\n");
+    return failed;
+}
+
+/* End of file */
+/*----------------------------------------------------------------------------*/